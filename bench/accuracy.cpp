@@ -0,0 +1,784 @@
+/*
+ * Rainbow golden-reference accuracy harness
+ *
+ * Runs step() against a frozen copy of the original plugin's kernel
+ * build and step(), with the features added since modelled on top of it
+ * by separate references (per-channel crossfades, latency, minimum phase
+ * and Energy, Chain, audio-rate morph). Every engine (direct form in
+ * float, Q15 and at half rate, which is within -60 dB on dark waves, FFT
+ * with 64 samples latency, zero-latency hybrid and audio-rate morph) is
+ * compared at every Resolution and channel counts 1-12 and up to 28, steady, through wavetable crossfades, with inputs
+ * falling silent (idle bypass), on the linear-phase tables (folded
+ * direct form), on dark waves, with minimum-phase kernels (made in
+ * double precision by the same method) at full and reduced Energy, and
+ * for 4096 tap chains and morph while Index sweeps. Reports the maximum
+ * absolute error and the SNR of the output against the reference.
+ *
+ * Usage: rainbow_accuracy [-v] [frames per step] [seconds of audio per config]
+ *   -v  one line per channel count instead of the worst case over all
+ */
+
+#include "../rainbow.cpp"
+#include "harness.h"
+
+#include <complex>
+#include <string.h>
+
+// Every count up to 12, then the SRAM-tier sizes
+static const int channelCounts[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 16, 20, 24, 28 };
+
+// ============================================================================
+// BASELINE ENGINE (FROZEN)
+// ============================================================================
+
+// Literal copies of buildKernelAtIndex() and step() from the original
+// plugin: one float kernel per channel blended from two waves and then
+// L1-normalised, a direct-form convolution, channel 0 ramping the
+// crossfade and the others taking its value at the end of the block.
+// Only the storage differs: the DTC and algorithm fields the two read
+// live in BaselineEngine, sized at run time, and step() reads and writes
+// channel arrays instead of busses. Do not edit these when the plugin's
+// behaviour changes; model the change in FEATURE REFERENCES below.
+
+struct BaselineChannelState {
+	std::vector<float> delayLine;  // 2 * kernelSize
+	int writePos;
+};
+
+struct BaselineEngine {
+	// _rainbow_DTC
+	float depth;
+	float gain;
+	float saturation;
+	int kernelSize;
+	int kernelMask;
+	bool crossfading;
+	float crossfadeMix;
+	std::vector<float> kernels[kMaxChannels];
+	std::vector<float> newKernels[kMaxChannels];
+	BaselineChannelState channels[kMaxChannels];
+	
+	// _rainbowAlgorithm
+	const int16_t* wavetableBuffer;
+	int numWaves;
+	int numChannels;
+	bool wavetableLoaded;
+};
+
+// Soft saturation using tanh approximation
+static inline float baselineSoftSaturate(float x, float amount) {
+	if (amount < 0.001f) return x;
+	float drive = 1.0f + amount * 4.0f;  // 1x to 5x drive
+	return tanh(x * drive) / tanh(drive);
+}
+
+static void baselineKernelAtIndex(BaselineEngine* pThis, float* dest, float indexParam) {
+	BaselineEngine* dtc = pThis;
+	
+	indexParam = std::max(0.0f, std::min(1.0f, indexParam));
+	float offset = indexParam * (pThis->numWaves - 1);
+	offset = std::max(0.0f, std::min(offset, (float)(pThis->numWaves - 1) - 0.0001f));
+	
+	int wave0 = (int)offset;
+	int wave1 = std::min(wave0 + 1, (int)pThis->numWaves - 1);
+	float frac = offset - wave0;
+	
+	const int kernelSize = dtc->kernelSize;
+	
+	const int16_t* mip0 = pThis->wavetableBuffer + kernelSize * (pThis->numWaves + wave0);
+	const int16_t* mip1 = pThis->wavetableBuffer + kernelSize * (pThis->numWaves + wave1);
+	
+	float sum = 0.0f;
+	for (int i = 0; i < kernelSize; ++i) {
+		float v0 = mip0[i] / 32768.0f;
+		float v1 = mip1[i] / 32768.0f;
+		dest[i] = v0 + frac * (v1 - v0);
+		sum += fabsf(dest[i]);
+	}
+	
+	if (sum > 0.001f) {
+		float scale = 1.0f / sum;
+		for (int i = 0; i < kernelSize; ++i) {
+			dest[i] *= scale;
+		}
+	}
+}
+
+static void baselineStep(BaselineEngine* pThis, const float* const* inputs, float* const* outputs, int numFramesBy4) {
+	BaselineEngine* dtc = pThis;
+	
+	const int numFrames = numFramesBy4 << 2;
+	const float depth = dtc->depth;
+	const float dryMix = 1.0f - depth;
+	const float gain = dtc->gain;
+	const float saturation = dtc->saturation;
+	const bool doConvolve = pThis->wavetableLoaded;
+	const bool doSaturate = saturation > 0.001f;
+	const int kernelSize = dtc->kernelSize;
+	const int kernelMask = dtc->kernelMask;
+	
+	bool crossfading = dtc->crossfading;
+	float crossfadeMix = dtc->crossfadeMix;
+	constexpr float kCrossfadeRate = 1.0f / 2400.0f;  // ~50ms at 48kHz
+	
+	for (int ch = 0; ch < pThis->numChannels; ++ch) {
+		const float* __restrict in = inputs[ch];
+		float* __restrict out = outputs[ch];
+		const bool replace = true;
+		BaselineChannelState* state = &dtc->channels[ch];
+		float* __restrict delay = state->delayLine.data();
+		int wp = state->writePos;
+		
+		const float* __restrict kernel = dtc->kernels[ch].data();
+		const float* __restrict newKernel = dtc->newKernels[ch].data();
+		float localMix = crossfadeMix;
+		
+		for (int i = 0; i < numFrames; ++i) {
+			const float dry = in[i];
+			delay[wp] = dry;
+			delay[wp + kernelSize] = dry;
+			
+			float wet;
+			if (doConvolve) {
+				const float* __restrict x = &delay[wp + kernelSize];
+				const float* __restrict h = kernel;
+				float a0 = 0.0f, a1 = 0.0f, a2 = 0.0f, a3 = 0.0f;
+				
+				for (int k = 0; k < kernelSize; k += 4) {
+					a0 = fmaf(x[0], h[k], a0);
+					a1 = fmaf(x[-1], h[k + 1], a1);
+					a2 = fmaf(x[-2], h[k + 2], a2);
+					a3 = fmaf(x[-3], h[k + 3], a3);
+					x -= 4;
+				}
+				float wetOld = (a0 + a1) + (a2 + a3);
+				
+				if (crossfading) {
+					x = &delay[wp + kernelSize];
+					h = newKernel;
+					a0 = 0.0f; a1 = 0.0f; a2 = 0.0f; a3 = 0.0f;
+					for (int k = 0; k < kernelSize; k += 4) {
+						a0 = fmaf(x[0], h[k], a0);
+						a1 = fmaf(x[-1], h[k + 1], a1);
+						a2 = fmaf(x[-2], h[k + 2], a2);
+						a3 = fmaf(x[-3], h[k + 3], a3);
+						x -= 4;
+					}
+					float wetNew = (a0 + a1) + (a2 + a3);
+					wet = wetOld + (wetNew - wetOld) * localMix;
+					if (ch == 0) localMix += kCrossfadeRate;
+				} else {
+					wet = wetOld;
+				}
+			} else {
+				wet = dry;
+			}
+			
+			wp = (wp + 1) & kernelMask;
+			
+			float mixed = fmaf(dry, dryMix, wet * depth);
+			if (doSaturate) mixed = baselineSoftSaturate(mixed, saturation);
+			mixed *= gain;
+			
+			if (replace) out[i] = mixed;
+			else out[i] += mixed;
+		}
+		state->writePos = wp;
+		
+		if (ch == 0 && crossfading) {
+			crossfadeMix = localMix;
+		}
+	}
+	
+	if (crossfading) {
+		if (crossfadeMix >= 1.0f) {
+			for (int ch = 0; ch < pThis->numChannels; ++ch) {
+				for (int i = 0; i < kernelSize; ++i) {
+					dtc->kernels[ch][i] = dtc->newKernels[ch][i];
+				}
+			}
+			dtc->crossfading = false;
+			dtc->crossfadeMix = 0.0f;
+		} else {
+			dtc->crossfadeMix = crossfadeMix;
+		}
+	}
+}
+
+// ============================================================================
+// FEATURE REFERENCES
+// ============================================================================
+
+// Models of what the plugin has gained since the baseline, each kept
+// apart from the frozen copy above and used only where its feature is on
+
+struct Reference {
+	int numChannels;
+	int kernelSize;  // a chain's length with Chain
+	int latency;     // wet delay of the engine under test
+	float depth;
+	float saturation;
+	float gain;
+	int table;
+	int index;   // Index parameter (0-1000)
+	int spread;  // Spread parameter (0-1000)
+	bool minPhase;
+	int energy;     // Energy parameter (per mille)
+	int chainTaps;  // 0 without Chain
+	bool morph;     // audio-rate morph: wave pairs blended per sample
+
+	BaselineEngine engines[kMaxChannels];    // one per channel (see referenceStep())
+	std::vector<float> rows[kStubNumWaves];  // morph: each wave as a kernel of its own
+	float morphIndex[kMaxChannels];          // morph position at the last block
+	bool pending;  // the instance switched to a new wavetable's kernels this block
+};
+
+// Channel positions under Spread (channelIndex())
+static float referenceIndex(const Reference& ref, int ch) {
+	float index = ref.index * 0.001f;
+	if (ref.spread >= 1 && ref.numChannels > 1) {
+		index += ref.spread * 0.001f * ((float)ch / (ref.numChannels - 1) - 0.5f);
+	}
+	return index;
+}
+
+// ----------------------------------------------------------------------------
+// Phase and Energy
+// ----------------------------------------------------------------------------
+
+typedef std::complex<double> Complex;
+
+// Unscaled radix-2 FFT in double precision, twiddles computed directly
+static void referenceFft(std::vector<Complex>& data, bool inverse) {
+	constexpr double kPi = 3.14159265358979323846;
+	const int n = (int)data.size();
+	for (int i = 1, j = 0; i < n; ++i) {
+		int bit = n >> 1;
+		for (; j & bit; bit >>= 1) j ^= bit;
+		j |= bit;
+		if (i < j) std::swap(data[i], data[j]);
+	}
+	for (int len = 2; len <= n; len <<= 1) {
+		const double theta = (inverse ? 2.0 : -2.0) * kPi / len;
+		for (int k = 0; k < len / 2; ++k) {
+			const Complex w = std::polar(1.0, theta * k);
+			for (int i = k; i < n; i += len) {
+				const Complex t = w * data[i + len / 2];
+				data[i + len / 2] = data[i] - t;
+				data[i] += t;
+			}
+		}
+	}
+}
+
+// makeMinimumPhase() in double precision: the real cepstrum of the
+// oversampled spectrum (floored 100 dB below its peak) folded to be
+// causal, then scaled back to the kernel's L1 norm
+static void referenceMinimumPhase(std::vector<float>& kernel) {
+	const int kernelSize = (int)kernel.size();
+	const int n = kernelSize * kMinPhaseOversample;
+	std::vector<Complex> work(n, 0.0);
+	double norm = 0.0;
+	for (int i = 0; i < kernelSize; ++i) {
+		work[i] = kernel[i];
+		norm += fabs(kernel[i]);
+	}
+	referenceFft(work, false);
+
+	double peak = 0.0;
+	for (int i = 0; i < n; ++i) {
+		peak = std::max(peak, std::norm(work[i]));
+	}
+	if (peak <= 0.0)
+		return;
+	for (int i = 0; i < n; ++i) {
+		work[i] = 0.5 * log(std::max(std::norm(work[i]), peak * 1e-10));
+	}
+
+	referenceFft(work, true);
+	for (int i = 0; i < n; ++i) {
+		double c = work[i].real() / n;
+		if (i > 0 && i < n / 2) c *= 2.0;
+		else if (i > n / 2) c = 0.0;
+		work[i] = c;
+	}
+
+	referenceFft(work, false);
+	for (int i = 0; i < n; ++i) {
+		work[i] = std::polar(exp(work[i].real()), work[i].imag());
+	}
+	referenceFft(work, true);
+
+	double sum = 0.0;
+	for (int i = 0; i < kernelSize; ++i) {
+		sum += fabs(work[i].real() / n);
+	}
+	const double scale = sum > 0.001 ? norm / sum : 1.0;
+	for (int i = 0; i < kernelSize; ++i) {
+		kernel[i] = (float)(work[i].real() / n * scale);
+	}
+}
+
+// One wave of the mip level as a float row, made minimum-phase if asked
+// (buildCacheRow()); returns its Energy length: the shortest prefix
+// holding the Energy fraction of its L2 energy, in steps of four taps
+static int referenceRow(const Reference& ref, int kernelSize, int wave, std::vector<float>& row) {
+	const int16_t* mip = stubWavetable(ref.table) + kernelSize * (kStubNumWaves + wave);
+	row.resize(kernelSize);
+	for (int i = 0; i < kernelSize; ++i) {
+		row[i] = mip[i] / 32768.0f;
+	}
+	if (ref.minPhase) {
+		referenceMinimumPhase(row);
+	}
+	if (ref.energy >= 1000)
+		return kernelSize;
+
+	double total = 0.0;
+	for (int i = 0; i < kernelSize; ++i) {
+		total += (double)row[i] * row[i];
+	}
+	double part = 0.0;
+	int taps = 0;
+	while (taps < kernelSize && part < total * ref.energy * 0.001) {
+		part += (double)row[taps] * row[taps];
+		++taps;
+	}
+	return std::max(4, (taps + 3) & ~3);
+}
+
+// A kernel between two waves under Phase and Energy (buildKernel()): the
+// rows blended and L1-normalised as the baseline blends waves, then cut
+// after the longer row's Energy length (a single wave's, at frac 0)
+static void referencePhaseKernel(const Reference& ref, int wave0, int wave1, float frac, std::vector<float>& dest) {
+	const int n = ref.kernelSize;
+	std::vector<float> row0, row1;
+	const int taps0 = referenceRow(ref, n, wave0, row0);
+	const int taps1 = referenceRow(ref, n, wave1, row1);
+	const int taps = frac == 0.0f ? taps0 : std::max(taps0, taps1);
+
+	dest.resize(n);
+	float sum = 0.0f;
+	for (int i = 0; i < n; ++i) {
+		dest[i] = row0[i] + frac * (row1[i] - row0[i]);
+		sum += fabsf(dest[i]);
+	}
+	const float scale = sum > 0.001f ? 1.0f / sum : 1.0f;
+	for (int i = 0; i < n; ++i) {
+		dest[i] = i < taps ? dest[i] * scale : 0.0f;
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Chain
+// ----------------------------------------------------------------------------
+
+// A chain kernel (buildChainTaps()): from the wave pair at the position
+// on, kMaxKernelSize taps per pair, each pair blended and L1-normalised
+// as the baseline blends waves, the pairs moving on a wave at a time
+// (wrapping around the table), all scaled by the square root of the
+// chain's length in waves
+static void referenceChainKernel(const Reference& ref, int wave0, int wave1, float frac, std::vector<float>& dest) {
+	constexpr int n = kMaxKernelSize;
+	const int16_t* table = stubWavetable(ref.table);
+	const float gain = 1.0f / sqrtf((float)(ref.chainTaps / n));
+	dest.resize(ref.chainTaps);
+	for (int segment = 0; segment < ref.chainTaps / n; ++segment) {
+		const int16_t* mip0 = table + n * (kStubNumWaves + (wave0 + segment) % kStubNumWaves);
+		const int16_t* mip1 = table + n * (kStubNumWaves + (wave1 + segment) % kStubNumWaves);
+		float* kernel = dest.data() + segment * n;
+		float sum = 0.0f;
+		for (int i = 0; i < n; ++i) {
+			const float v0 = mip0[i] / 32768.0f;
+			const float v1 = mip1[i] / 32768.0f;
+			kernel[i] = v0 + frac * (v1 - v0);
+			sum += fabsf(kernel[i]);
+		}
+		const float scale = sum > 0.001f ? gain / sum : gain;
+		for (int i = 0; i < n; ++i) {
+			kernel[i] *= scale;
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Kernels and per-channel crossfades
+// ----------------------------------------------------------------------------
+
+// The kernel of channel ch: the baseline's unless Phase, Energy or Chain
+// change it
+static void referenceKernel(Reference& ref, int ch, std::vector<float>& dest) {
+	BaselineEngine* engine = &ref.engines[ch];
+	const float indexParam = referenceIndex(ref, ch);
+	if (!ref.minPhase && ref.energy >= 1000 && !ref.chainTaps) {
+		dest.resize(engine->kernelSize);
+		baselineKernelAtIndex(engine, dest.data(), indexParam);
+		return;
+	}
+
+	const int numWaves = kStubNumWaves;
+	float offset = std::max(0.0f, std::min(1.0f, indexParam)) * (numWaves - 1);
+	offset = std::max(0.0f, std::min(offset, (float)(numWaves - 1) - 0.0001f));
+	const int wave0 = (int)offset;
+	const int wave1 = std::min(wave0 + 1, numWaves - 1);
+	const float frac = offset - wave0;
+	if (ref.chainTaps) {
+		referenceChainKernel(ref, wave0, wave1, frac, dest);
+	} else {
+		referencePhaseKernel(ref, wave0, wave1, frac, dest);
+	}
+}
+
+// Every channel now crossfades on its own schedule, ramping per sample as
+// the baseline's channel 0 does, so each channel runs in a one-channel
+// baseline engine of its own
+static void initReference(Reference& ref) {
+	for (int ch = 0; ch < ref.numChannels; ++ch) {
+		BaselineEngine* engine = &ref.engines[ch];
+		engine->depth = ref.depth;
+		engine->gain = ref.gain;
+		engine->saturation = ref.saturation;
+		engine->kernelSize = ref.kernelSize;
+		engine->kernelMask = ref.kernelSize - 1;
+		engine->crossfading = false;
+		engine->crossfadeMix = 0.0f;
+		engine->channels[0].delayLine.assign(2 * ref.kernelSize, 0.0f);
+		engine->channels[0].writePos = 0;
+		engine->wavetableBuffer = stubWavetable(ref.table);
+		engine->numWaves = kStubNumWaves;
+		engine->numChannels = 1;
+		engine->wavetableLoaded = true;
+		referenceKernel(ref, ch, engine->kernels[0]);
+		engine->newKernels[0] = engine->kernels[0];
+	}
+}
+
+// A new wavetable, as the baseline's wavetable callback crossfades to it
+static void referenceCrossfade(Reference& ref) {
+	for (int ch = 0; ch < ref.numChannels; ++ch) {
+		BaselineEngine* engine = &ref.engines[ch];
+		engine->wavetableBuffer = stubWavetable(ref.table);
+		referenceKernel(ref, ch, engine->newKernels[0]);
+		engine->crossfadeMix = 0.0f;
+		engine->crossfading = true;
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Audio-rate morph
+// ----------------------------------------------------------------------------
+
+static void buildReferenceRows(Reference& ref) {
+	for (int w = 0; w < kStubNumWaves; ++w) {
+		referencePhaseKernel(ref, w, w, 0.0f, ref.rows[w]);
+	}
+}
+
+// Wet output at time t through one kernel, in double precision.
+// input holds kernelSize zeros of history ahead of time 0.
+static double convolve(const std::vector<float>& kernel, const float* input, int t) {
+	double acc = 0.0;
+	for (int k = 0; k < (int)kernel.size(); ++k) {
+		acc += (double)kernel[k] * input[t - k];
+	}
+	return acc;
+}
+
+static double referenceMix(const Reference& ref, double dry, double wet) {
+	double mixed = dry * (1.0 - ref.depth) + wet * ref.depth;
+	if (ref.saturation >= 0.001f) {
+		const double drive = 1.0 + ref.saturation * 4.0;
+		mixed = tanh(mixed * drive) / tanh(drive);
+	}
+	return mixed * ref.gain;
+}
+
+// One step() in morph: the two waves around each channel's position at
+// the end of the block, each convolved as a kernel of its own in double
+// precision and their outputs blended per sample as the position moves
+// there from the last block's
+static void referenceMorphStep(Reference& ref, float* const* inputs, double* const* outputs, int t0, int numFrames) {
+	const int numWaves = kStubNumWaves;
+	for (int ch = 0; ch < ref.numChannels; ++ch) {
+		const float target = referenceIndex(ref, ch);
+		const float start = ref.morphIndex[ch];
+		const int pair = std::min((int)(std::max(0.0f, std::min(target, 1.0f)) * (numWaves - 1)), numWaves - 2);
+		for (int i = 0; i < numFrames; ++i) {
+			const int t = t0 + i;
+			double wet = 0.0;
+			if (t >= ref.latency) {
+				const double pos = start + (double)(target - start) * i / numFrames;
+				const double offset = std::max(0.0, std::min(pos, 1.0)) * (numWaves - 1);
+				const double mix = std::max(0.0, std::min(offset - pair, 1.0));
+				const double wet0 = convolve(ref.rows[pair], inputs[ch], t - ref.latency);
+				const double wet1 = convolve(ref.rows[pair + 1], inputs[ch], t - ref.latency);
+				wet = wet0 + (wet1 - wet0) * mix;
+			}
+			outputs[ch][t] = referenceMix(ref, inputs[ch][t], wet);
+		}
+		ref.morphIndex[ch] = target;
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Latency
+// ----------------------------------------------------------------------------
+
+// One step() of the instance from frame t0. The FFT engine's latency
+// delays the wet signal only; at full Depth that is the baseline run on
+// input delayed by as much.
+static void referenceStep(Reference& ref, float* const* inputs, double* const* outputs, int t0, int numFrames) {
+	if (ref.morph) {
+		referenceMorphStep(ref, inputs, outputs, t0, numFrames);
+		return;
+	}
+	if (ref.pending && !ref.engines[0].crossfading) {
+		referenceCrossfade(ref);
+		ref.pending = false;
+	}
+
+	std::vector<float> out(numFrames);
+	for (int ch = 0; ch < ref.numChannels; ++ch) {
+		const float* in = inputs[ch] + t0 - ref.latency;
+		float* o = out.data();
+		baselineStep(&ref.engines[ch], &in, &o, numFrames / 4);
+		for (int i = 0; i < numFrames; ++i) {
+			outputs[ch][t0 + i] = out[i];
+		}
+	}
+}
+
+// ============================================================================
+// CONFIGURATIONS
+// ============================================================================
+
+enum {
+	kEngineDirect,
+	kEngineHalfRate,  // direct form with Engine = Half rate
+	kEngineFixed,
+	kEngineFft,
+	kEngineHybrid,
+	kEngineMorph,
+};
+
+static const char* const engineNames[] = { "direct", "half", "fixed", "fft", "hybrid", "morph" };
+
+struct Scenario {
+	const char* name;
+	int index;
+	int spread;
+	int saturation;
+	int gain;        // dB * 10
+	bool crossfade;  // switch wavetables twice during the run
+	bool gated;      // silent stretches, staggered per channel (idle bypass)
+	int table;       // starting wavetable (2 and 3 are symmetric and antisymmetric)
+	bool minPhase;   // Phase = Minimum
+	int energy;      // Energy parameter (per mille)
+	int chain;       // Chain parameter (512 taps on the FFT engines only)
+	int sweep;       // Index step per step() (morph only)
+};
+
+static const Scenario scenarios[] = {
+	{ "steady",    500, 0,   0,  0,  false, false, 0, false, 1000, 0, 0 },
+	{ "spread",    370, 500, 0,  0,  false, false, 0, false, 1000, 0, 0 },
+	{ "saturate",  370, 500, 60, 60, false, false, 0, false, 1000, 0, 0 },
+	{ "crossfade", 370, 500, 0,  0,  true,  false, 0, false, 1000, 0, 0 },
+	{ "gated",     370, 500, 0,  0,  false, true,  0, false, 1000, 0, 0 },
+	{ "even",      370, 500, 0,  0,  false, false, 2, false, 1000, 0, 0 },
+	{ "odd",       370, 500, 0,  0,  false, false, 3, false, 1000, 0, 0 },
+	{ "dark",      1000, 200, 0, 0,  false, false, 0, false, 1000, 0, 0 },
+	{ "minphase",  370, 500, 0,  0,  false, false, 0, true,  1000, 0, 0 },
+	{ "energy",    370, 500, 0,  0,  false, false, 0, true,  900,  0, 0 },
+	{ "chain",     370, 500, 0,  0,  false, false, 0, false, 1000, 2, 0 },
+	{ "sweep",     100, 500, 0,  0,  false, false, 0, false, 1000, 0, 1 },
+};
+
+// Input history ahead of time 0: the longest kernel
+static constexpr int kHistory = kChainSizes[kNumChainSizes - 1];
+
+// Gated inputs: silences long enough for every channel to go idle
+static constexpr int kGatePeriod = 3000;
+static constexpr int kGateStagger = 700;
+
+struct Result {
+	double maxError;
+	double snr;  // dB, INFINITY when exact
+};
+
+// ============================================================================
+// COMPARISON
+// ============================================================================
+
+static Result runConfig(int engine, int resolution, int numChannels, const Scenario& scenario,
+                        int framesPerStep, double seconds) {
+	const int kernelSize = kKernelSizes[resolution];
+	const int totalFrames = ((int)(seconds * NT_globals.sampleRate) / framesPerStep) * framesPerStep;
+	const int switchFrames[2] = { totalFrames / 5, totalFrames * 3 / 5 };
+
+	// The direct-form engines run with only the lines they need (Max
+	// Engine at the Engine they use); the others with all of them
+	const int directEngine = engine == kEngineFixed ? kDirectFixed
+	                       : engine == kEngineHalfRate ? kDirectHalfRate : kDirectFloat;
+	const int maxEngine = engine == kEngineDirect || engine == kEngineFixed ? directEngine : kDirectHalfRate;
+	Instance inst;
+	createInstance(inst, numChannels, kMaxKernelSize, kChainSizes[scenario.chain], maxEngine);
+	setParameter(inst, kParamDepth, 100);
+	setParameter(inst, kParamKernelSize, resolution);
+	setParameter(inst, kParamLatency, engine == kEngineFft ? 1 : 0);
+	setParameter(inst, kParamMorph, engine == kEngineMorph ? 1 : 0);
+	setParameter(inst, kParamEngine, directEngine);
+	setParameter(inst, kParamIndex, scenario.index);
+	setParameter(inst, kParamSpread, scenario.spread);
+	setParameter(inst, kParamSaturation, scenario.saturation);
+	setParameter(inst, kParamGain, scenario.gain);
+	setParameter(inst, kParamWavetable, scenario.table);
+	setParameter(inst, kParamPhase, scenario.minPhase ? 1 : 0);
+	setParameter(inst, kParamEnergy, scenario.energy);
+	setParameter(inst, kParamChain, scenario.chain);
+
+	std::vector<float> bus(kNumBuses * framesPerStep);
+	loadFirstWavetable(inst, bus.data(), framesPerStep);
+
+	Reference ref;
+	ref.numChannels = numChannels;
+	ref.kernelSize = scenario.chain ? kChainSizes[scenario.chain] : kernelSize;
+	ref.latency = engine == kEngineFft ? kFftBlockSize : 0;
+	ref.depth = 1.0f;
+	ref.saturation = scenario.saturation / 100.0f;
+	ref.gain = pow(10.0f, scenario.gain / 10.0f / 20.0f);
+	ref.table = scenario.table;
+	ref.index = scenario.index;
+	ref.spread = scenario.spread;
+	ref.minPhase = scenario.minPhase;
+	ref.energy = scenario.energy;
+	ref.chainTaps = kChainSizes[scenario.chain];
+	ref.morph = engine == kEngineMorph;
+	ref.pending = false;
+	initReference(ref);
+	if (ref.morph) {
+		buildReferenceRows(ref);
+	}
+	for (int ch = 0; ch < numChannels; ++ch) {
+		ref.morphIndex[ch] = referenceIndex(ref, ch);
+	}
+
+	// Inputs carry kHistory samples of silent history; the instance has
+	// only seen silence so far
+	std::vector<float> input[kMaxChannels];
+	std::vector<double> expected[kMaxChannels];
+	float* inputs[kMaxChannels];
+	double* outputs[kMaxChannels];
+	uint32_t seed = 12345;
+	for (int ch = 0; ch < numChannels; ++ch) {
+		input[ch].assign(kHistory + totalFrames, 0.0f);
+		for (int t = kHistory; t < (int)input[ch].size(); ++t) {
+			seed = seed * 1664525u + 1013904223u;
+			const bool silent = scenario.gated && ((t + ch * kGateStagger) / kGatePeriod) % 2 == 1;
+			input[ch][t] = silent ? 0.0f : (seed >> 8) * (1.0f / 16777216.0f) - 0.5f;
+		}
+		expected[ch].assign(totalFrames, 0.0);
+		inputs[ch] = input[ch].data() + kHistory;
+		outputs[ch] = expected[ch].data();
+	}
+
+	int table = scenario.table;
+	bool loading = false;  // until the instance picks up the new table's kernels
+	const _rainbow_DTC* dtc = ((_rainbowAlgorithm*)inst.alg)->dtc;
+	double errorEnergy = 0.0, signalEnergy = 0.0, maxError = 0.0;
+	for (int t0 = 0; t0 < totalFrames; t0 += framesPerStep) {
+		if (scenario.crossfade && (t0 == switchFrames[0] || t0 == switchFrames[1])) {
+			table ^= 1;
+			setParameter(inst, kParamWavetable, table);
+			stubServiceWavetable();
+			loading = true;
+		}
+		if (scenario.sweep) {
+			ref.index = std::min(scenario.index + scenario.sweep * (t0 / framesPerStep), 1000);
+			if (ref.index != inst.values[kParamIndex]) setParameter(inst, kParamIndex, ref.index);
+		}
+
+		for (int ch = 0; ch < numChannels; ++ch) {
+			memcpy(inputBus(bus.data(), ch, framesPerStep), inputs[ch] + t0, framesPerStep * sizeof(float));
+		}
+		const int frontBank = dtc->frontBank;
+		factory.step(inst.alg, bus.data(), framesPerStep / 4);
+		if (loading && dtc->frontBank != frontBank) {
+			loading = false;
+			ref.table = table;
+			ref.pending = true;
+		}
+		referenceStep(ref, inputs, outputs, t0, framesPerStep);
+
+		for (int ch = 0; ch < numChannels; ++ch) {
+			const float* out = outputBus(bus.data(), ch, numChannels, framesPerStep);
+			for (int i = 0; i < framesPerStep; ++i) {
+				const double e = out[i] - outputs[ch][t0 + i];
+				errorEnergy += e * e;
+				signalEnergy += outputs[ch][t0 + i] * outputs[ch][t0 + i];
+				maxError = std::max(maxError, fabs(e));
+			}
+		}
+	}
+	destroyInstance(inst);
+
+	Result r;
+	r.maxError = maxError;
+	r.snr = errorEnergy > 0.0 ? 10.0 * log10(signalEnergy / errorEnergy) : INFINITY;
+	return r;
+}
+
+static void printResult(int engine, int kernelSize, const Scenario& scenario, const char* channels, const Result& r) {
+	printf("%-7s %5d %-10s %5s %12.3e", engineNames[engine], kernelSize, scenario.name, channels, r.maxError);
+	if (isinf(r.snr)) printf(" %9s\n", "exact");
+	else printf(" %9.1f\n", r.snr);
+}
+
+int main(int argc, char** argv) {
+	bool verbose = false;
+	if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+		verbose = true;
+		--argc;
+		++argv;
+	}
+	int framesPerStep = argc > 1 ? atoi(argv[1]) : 24;
+	const double seconds = argc > 2 ? atof(argv[2]) : 0.25;
+	framesPerStep = std::max(4, std::min((framesPerStep + 3) & ~3, (int)NT_globals.maxFramesPerStep));
+
+	printf("Rainbow accuracy against the direct-form reference: %d frames per step, %.2fs per config\n\n",
+	       framesPerStep, seconds);
+	printf("%-7s %5s %-10s %5s %12s %9s\n", "engine", "taps", "scenario", "ch", "max error", "SNR dB");
+
+	for (int engine = kEngineDirect; engine <= kEngineMorph; ++engine) {
+		for (int r = 0; r < kNumKernelSizes; ++r) {
+			const bool fft = useFftEngine(kKernelSizes[r]);
+			if (((engine == kEngineDirect || engine == kEngineHalfRate || engine == kEngineFixed) && fft) || ((engine == kEngineFft || engine == kEngineHybrid) && !fft))
+				continue;
+
+			for (const Scenario& scenario : scenarios) {
+				if (engine == kEngineMorph && (scenario.crossfade || scenario.chain))
+					continue;  // morph owns both banks; wavetable loads restart it, and chains are off
+				if (scenario.chain && (!fft || kKernelSizes[r] != kMaxKernelSize))
+					continue;  // chains play at 512 taps
+				if (scenario.sweep && engine != kEngineMorph)
+					continue;  // outside morph, every step of Index is a crossfade to new kernels
+
+				const int taps = scenario.chain ? kChainSizes[scenario.chain] : kKernelSizes[r];
+				Result worst = { 0.0, INFINITY };
+				for (int numChannels : channelCounts) {
+					const Result result = runConfig(engine, r, numChannels, scenario, framesPerStep, seconds);
+					if (verbose) {
+						char channels[8];
+						snprintf(channels, sizeof(channels), "%d", numChannels);
+						printResult(engine, taps, scenario, channels, result);
+					}
+					worst.maxError = std::max(worst.maxError, result.maxError);
+					worst.snr = std::min(worst.snr, result.snr);
+				}
+				if (!verbose) {
+					printResult(engine, taps, scenario, "1-28", worst);
+				}
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * Rainbow host benchmark
+ *
+ * Builds rainbow.cpp against the stub firmware in nt_stub.cpp and times
+ * step() across Channels, Resolution, Spread, crossfade, morph,
+ * saturation, Engine and Chain settings, and on linear-phase and dark
+ * (half-rate) waves. Only step() is timed, which includes the kernel builds
+ * the crossfade configurations trigger (step() runs them within its budget).
+ *
+ * Usage: rainbow_bench [frames per step] [seconds of audio per config]
+ */
+
+#include "../rainbow.cpp"
+#include "harness.h"
+
+#include <chrono>
+
+static constexpr int kCrossfadeInterval = 2400;  // frames between wavetable reloads
+
+// ============================================================================
+// CONFIGURATIONS
+// ============================================================================
+
+struct BenchVariant {
+	const char* name;
+	int spread;      // Spread parameter (0-1000)
+	int saturation;  // Saturation parameter (0-100)
+	int morph;       // Morph parameter
+	int engine;      // Engine parameter (fixed point at 64 and 128 taps, 2: half rate)
+	int table;       // wavetable (2: symmetric waves, folded at 64 and 128 taps)
+	int index;       // Index parameter (1000: dark waves, half rate at 128 taps)
+	bool crossfade;  // keep a wavetable crossfade running
+	int chain;       // Chain parameter (index into kChainSizes, Max Chain set to match)
+};
+
+static const BenchVariant variants[] = {
+	{ "plain",     0,   0,  0, 0, 0, 500,  false, 0 },
+	{ "spread",    500, 0,  0, 0, 0, 500,  false, 0 },
+	{ "saturate",  0,   50, 0, 0, 0, 500,  false, 0 },
+	{ "crossfade", 500, 0,  0, 0, 0, 500,  true,  0 },
+	{ "morph",     500, 0,  1, 0, 0, 500,  false, 0 },
+	{ "fixed",     500, 0,  0, 1, 0, 500,  false, 0 },
+	{ "folded",    500, 0,  0, 0, 2, 500,  false, 0 },
+	{ "dark",      200, 0,  0, 2, 0, 1000, false, 0 },
+	{ "chain",     500, 0,  0, 0, 0, 500,  false, 3 },
+};
+
+static const int channelCounts[] = { 1, 2, 6, 12, 16, 24, 28 };
+
+// ============================================================================
+// BENCHMARK
+// ============================================================================
+
+// Returns nanoseconds per frame
+static double runConfig(int numChannels, int resolution, const BenchVariant& variant,
+                        int framesPerStep, double seconds) {
+	Instance inst;
+	createInstance(inst, numChannels, kMaxKernelSize, kChainSizes[variant.chain]);
+	setParameter(inst, kParamKernelSize, resolution);
+	setParameter(inst, kParamSpread, variant.spread);
+	setParameter(inst, kParamSaturation, variant.saturation);
+	setParameter(inst, kParamMorph, variant.morph);
+	setParameter(inst, kParamEngine, variant.engine);
+	setParameter(inst, kParamWavetable, variant.table);
+	setParameter(inst, kParamIndex, variant.index);
+	setParameter(inst, kParamChain, variant.chain);
+
+	std::vector<float> bus(kNumBuses * framesPerStep, 0.0f);
+	std::vector<float> noise(kNumBuses * framesPerStep * 16);
+	srand(1);
+	for (size_t i = 0; i < noise.size(); ++i) {
+		noise[i] = rand() / (float)RAND_MAX - 0.5f;
+	}
+
+	loadFirstWavetable(inst, bus.data(), framesPerStep);
+
+	const int totalFrames = (int)(seconds * NT_globals.sampleRate);
+	const int warmupFrames = NT_globals.sampleRate / 10;
+	int sinceReload = 0;
+	int table = variant.table;
+	double elapsed = 0.0;
+	int timedFrames = 0;
+
+	for (int frame = 0, block = 0; frame < warmupFrames + totalFrames; frame += framesPerStep, ++block) {
+		if (variant.crossfade && (sinceReload += framesPerStep) >= kCrossfadeInterval) {
+			sinceReload = 0;
+			table ^= 1;
+			setParameter(inst, kParamWavetable, table);
+			stubServiceWavetable();
+		}
+		memcpy(bus.data(), &noise[(block & 15) * kNumBuses * framesPerStep], bus.size() * sizeof(float));
+
+		const auto start = std::chrono::steady_clock::now();
+		factory.step(inst.alg, bus.data(), framesPerStep / 4);
+		const auto end = std::chrono::steady_clock::now();
+
+		if (frame >= warmupFrames) {
+			elapsed += std::chrono::duration<double, std::nano>(end - start).count();
+			timedFrames += framesPerStep;
+		}
+	}
+
+	destroyInstance(inst);
+	return elapsed / timedFrames;
+}
+
+int main(int argc, char** argv) {
+	int framesPerStep = argc > 1 ? atoi(argv[1]) : 24;
+	const double seconds = argc > 2 ? atof(argv[2]) : 0.5;
+	framesPerStep = std::max(4, std::min((framesPerStep + 3) & ~3, (int)NT_globals.maxFramesPerStep));
+
+	printf("Rainbow step() benchmark: %d frames per step, %.2fs of audio per config\n\n",
+	       framesPerStep, seconds);
+	printf("%-10s %3s %5s %12s %14s %14s %10s\n",
+	       "variant", "ch", "taps", "ns/frame", "ns/ch-sample", "frames/s", "realtime");
+
+	for (const BenchVariant& variant : variants) {
+		for (int numChannels : channelCounts) {
+			for (int r = 0; r < kNumKernelSizes; ++r) {
+				// Chain always plays at 512 taps
+				if (variant.chain && r != kNumKernelSizes - 1)
+					continue;
+				const double ns = runConfig(numChannels, r, variant, framesPerStep, seconds);
+				const double framesPerSecond = 1e9 / ns;
+				const int taps = variant.chain ? kChainSizes[variant.chain] : kKernelSizes[r];
+				printf("%-10s %3d %5d %12.1f %14.2f %14.0f %9.1fx\n",
+				       variant.name, numChannels, taps, ns, ns / numChannels,
+				       framesPerSecond, framesPerSecond / NT_globals.sampleRate);
+			}
+		}
+		printf("\n");
+	}
+	return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * Plugin instance helpers shared by the host harnesses. Included after
+ * rainbow.cpp, so the factory and parameter enums are visible.
+ */
+
+#pragma once
+
+#include "nt_stub.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+static constexpr int kNumBuses = 28;
+static constexpr int kFirstOutputBus = 13;
+
+struct Instance {
+	_NT_algorithmRequirements req;
+	void* sram;
+	void* dram;
+	void* dtc;
+	_NT_algorithm* alg;
+	std::vector<int16_t> values;
+	int numChannels;
+};
+
+static void* allocAligned(size_t size) {
+	void* p = NULL;
+	if (posix_memalign(&p, 64, std::max(size, (size_t)64)) != 0) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	return p;
+}
+
+static void setParameter(Instance& inst, int p, int value) {
+	inst.values[p] = value;
+	factory.parameterChanged(inst.alg, p);
+}
+
+// Channel ch reads bus ch + 1 and replaces bus 13 + ch, or replaces its
+// own input above 12 channels, where the two ranges would overlap
+static inline int outputBusNumber(int ch, int numChannels) {
+	return numChannels <= kFirstOutputBus - 1 ? kFirstOutputBus + ch : 1 + ch;
+}
+
+static inline float* inputBus(float* busFrames, int ch, int numFrames) {
+	return busFrames + ch * numFrames;
+}
+
+static inline float* outputBus(float* busFrames, int ch, int numChannels, int numFrames) {
+	return busFrames + (outputBusNumber(ch, numChannels) - 1) * numFrames;
+}
+
+// Static memory (the shared wavetables and their load buffer), once per process
+static void initialisePlugin() {
+	static bool initialised = false;
+	if (initialised || !factory.calculateStaticRequirements)
+		return;
+	_NT_staticRequirements req;
+	factory.calculateStaticRequirements(req);
+	_NT_staticMemoryPtrs ptrs = { (uint8_t*)allocAligned(req.dram) };
+	factory.initialise(ptrs, req);
+	initialised = true;
+}
+
+static void createInstance(Instance& inst, int numChannels, int maxResolution = kMaxKernelSize, int maxChain = 0,
+                           int maxEngine = kDirectHalfRate) {
+	initialisePlugin();
+	const int32_t specs[] = { numChannels, maxResolution, maxChain, maxEngine };
+	factory.calculateRequirements(inst.req, specs);
+	inst.sram = allocAligned(inst.req.sram);
+	inst.dram = allocAligned(inst.req.dram);
+	inst.dtc = allocAligned(inst.req.dtc);
+	_NT_algorithmMemoryPtrs ptrs = { (uint8_t*)inst.sram, (uint8_t*)inst.dram, (uint8_t*)inst.dtc, NULL };
+	inst.alg = factory.construct(ptrs, inst.req, specs);
+	inst.numChannels = numChannels;
+
+	// Host side of the parameters: defaults, with every output in replace mode
+	inst.values.resize(inst.req.numParameters);
+	for (int p = 0; p < (int)inst.req.numParameters; ++p) {
+		inst.values[p] = inst.alg->parameters[p].def;
+	}
+	for (int ch = 0; ch < numChannels; ++ch) {
+		const int base = kNumSharedParams + ch * kParamsPerChannel;
+		inst.values[base + kParamInput] = 1 + ch;
+		inst.values[base + kParamOutput] = outputBusNumber(ch, numChannels);
+		inst.values[base + kParamOutputMode] = 1;
+	}
+	inst.alg->v = inst.values.data();
+	for (int p = 0; p < (int)inst.req.numParameters; ++p) {
+		factory.parameterChanged(inst.alg, p);
+	}
+}
+
+// True until step() has adopted the waves offered to it, built the kernels
+// requested and picked them up (and, morphing, every channel's pair)
+static bool kernelsPending(const Instance& inst) {
+	const _rainbowAlgorithm* alg = (const _rainbowAlgorithm*)inst.alg;
+	return alg->offeredSlot.load() != NULL || alg->jobRequest.load() != 0 || alg->job.stage != kStageIdle
+	    || alg->dtc->generation.load() != alg->dtc->consumedGeneration || alg->dtc->morphPending;
+}
+
+// The first step sees the card and requests the wavetable (or finds it
+// already loaded by another instance), and later ones build its kernels.
+// Silence then runs through a full FFT block, where the latency mode
+// takes effect.
+static void loadFirstWavetable(Instance& inst, float* busFrames, int framesPerStep) {
+	const _rainbowAlgorithm* alg = (const _rainbowAlgorithm*)inst.alg;
+	for (int frames = 0; frames < kFftBlockSize + framesPerStep; frames += framesPerStep) {
+		memset(busFrames, 0, kNumBuses * framesPerStep * sizeof(float));
+		factory.step(inst.alg, busFrames, framesPerStep / 4);
+		stubServiceWavetable();
+		if (!alg->wavetableLoaded || kernelsPending(inst)) frames = 0;
+	}
+}
+
+static void destroyInstance(Instance& inst) {
+	free(inst.sram);
+	free(inst.dram);
+	free(inst.dtc);
+}
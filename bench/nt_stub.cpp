@@ -0,0 +1,258 @@
+/*
+ * Host stand-in for the distingNT firmware (see nt_stub.h)
+ */
+
+#include "nt_stub.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+const _NT_globals NT_globals = { 48000, 128 };
+
+static bool cardMounted = true;
+static _NT_wavetableRequest* pendingRequest = NULL;
+
+// ============================================================================
+// SYNTHETIC WAVETABLES
+// ============================================================================
+
+// Mipmap layout as used by the firmware: the level of size L holds wave w
+// at offset L * (numWaves + w). Tables 0 and 1 have no symmetry; every wave
+// of table 2 is an even function about its midpoint, and every wave of
+// table 3 an odd function about sample L / 2 (linear-phase kernels).
+static void synthesiseWavetable(int table, int16_t* dest) {
+	constexpr float kPi = 3.14159265358979f;
+	constexpr int kMaxHarmonics = 64;
+
+	for (int w = 0; w < kStubNumWaves; ++w) {
+		// Spectral tilt and phase spread vary across the table (and per table)
+		const float tilt = 0.5f + 2.0f * w / (kStubNumWaves - 1);
+		const float phaseSpread = table < 2 ? 0.37f * (table + 1) + 0.11f * w : 0.0f;
+		const float phase = table == 2 ? 0.5f * kPi : 0.0f;
+		const float halfSample = table == 2 ? 0.5f : 0.0f;
+
+		for (int size = kStubWaveLength; size >= 4; size >>= 1) {
+			int16_t* wave = dest + size * (kStubNumWaves + w);
+			const int harmonics = std::min(kMaxHarmonics, size / 2 - 1);
+			std::vector<float> v(size, 0.0f);
+			float peak = 0.0f;
+			for (int i = 0; i < size; ++i) {
+				for (int h = 1; h <= harmonics; ++h) {
+					v[i] += powf((float)h, -tilt) * sinf(2.0f * kPi * h * (i + halfSample) / size + phase + phaseSpread * h * h);
+				}
+				peak = std::max(peak, fabsf(v[i]));
+			}
+			const float scale = peak > 0.0f ? 0.9f * 32767.0f / peak : 0.0f;
+			for (int i = 0; i < size; ++i) {
+				wave[i] = (int16_t)lrintf(v[i] * scale);
+			}
+		}
+	}
+}
+
+// ============================================================================
+// API STUBS
+// ============================================================================
+
+void NT_drawText(int, int, const char*, int, _NT_textAlignment, _NT_textSize) {}
+void NT_drawShapeI(_NT_shape, int, int, int, int, int) {}
+void NT_drawShapeF(_NT_shape, float, float, float, float, float) {}
+
+int NT_intToString(char* buffer, int32_t value) {
+	return sprintf(buffer, "%d", (int)value);
+}
+
+int NT_floatToString(char* buffer, float value, int decimalPlaces) {
+	return sprintf(buffer, "%.*f", decimalPlaces, value);
+}
+
+int32_t NT_algorithmIndex(const _NT_algorithm*) {
+	return 0;
+}
+
+void NT_updateParameterDefinition(uint32_t, uint32_t) {}
+
+bool NT_isSdCardMounted() {
+	return cardMounted;
+}
+
+uint32_t NT_getNumWavetables() {
+	return kStubNumWavetables;
+}
+
+void NT_getWavetableInfo(uint32_t index, _NT_wavetableInfo& info) {
+	static const char* const names[kStubNumWavetables] = { "Bench A", "Bench B", "Bench C", "Bench D" };
+	info.name = index < kStubNumWavetables ? names[index] : NULL;
+	info.numWaves = kStubNumWaves;
+	info.waveLength = kStubWaveLength;
+}
+
+bool NT_readWavetable(_NT_wavetableRequest& request) {
+	if (!cardMounted || pendingRequest)
+		return false;
+	pendingRequest = &request;
+	return true;
+}
+
+// ============================================================================
+// PRESET JSON
+// ============================================================================
+
+static StubJsonToken& addToken(void* refCon, StubJsonToken::Type type) {
+	StubJsonDocument& doc = *(StubJsonDocument*)refCon;
+	if (!doc.open.empty()) {
+		StubJsonToken& parent = doc.tokens[doc.open.back()];
+		if (parent.type == StubJsonToken::kArray || type == StubJsonToken::kName)
+			++parent.count;
+	}
+	StubJsonToken token = { type, std::string(), 0.0f, 0 };
+	doc.tokens.push_back(token);
+	return doc.tokens.back();
+}
+
+static void openContainer(void* refCon, StubJsonToken::Type type) {
+	StubJsonDocument& doc = *(StubJsonDocument*)refCon;
+	addToken(refCon, type);
+	doc.open.push_back(doc.tokens.size() - 1);
+}
+
+static void closeContainer(void* refCon) {
+	((StubJsonDocument*)refCon)->open.pop_back();
+}
+
+_NT_jsonStream::_NT_jsonStream(void* r) : refCon(r) {}
+_NT_jsonStream::~_NT_jsonStream() {}
+void _NT_jsonStream::openArray() { openContainer(refCon, StubJsonToken::kArray); }
+void _NT_jsonStream::closeArray() { closeContainer(refCon); }
+void _NT_jsonStream::openObject() { openContainer(refCon, StubJsonToken::kObject); }
+void _NT_jsonStream::closeObject() { closeContainer(refCon); }
+void _NT_jsonStream::addMemberName(const char* name) { addToken(refCon, StubJsonToken::kName).text = name; }
+void _NT_jsonStream::addNumber(int value) { addToken(refCon, StubJsonToken::kNumber).number = (float)value; }
+void _NT_jsonStream::addNumber(float value) { addToken(refCon, StubJsonToken::kNumber).number = value; }
+void _NT_jsonStream::addString(const char* str) { addToken(refCon, StubJsonToken::kString).text = str; }
+void _NT_jsonStream::addFourCC(uint32_t fourcc) { addToken(refCon, StubJsonToken::kNumber).number = (float)fourcc; }
+void _NT_jsonStream::addBoolean(bool value) { addToken(refCon, StubJsonToken::kBoolean).number = value; }
+void _NT_jsonStream::addNull() { addToken(refCon, StubJsonToken::kNull); }
+
+// The next token if it has the given type (and consumes it)
+static const StubJsonToken* takeToken(void* refCon, StubJsonToken::Type type) {
+	StubJsonDocument& doc = *(StubJsonDocument*)refCon;
+	if (doc.pos >= doc.tokens.size() || doc.tokens[doc.pos].type != type)
+		return NULL;
+	return &doc.tokens[doc.pos++];
+}
+
+static bool skipValue(void* refCon) {
+	StubJsonDocument& doc = *(StubJsonDocument*)refCon;
+	if (doc.pos >= doc.tokens.size())
+		return false;
+	const StubJsonToken& token = doc.tokens[doc.pos++];
+	const int values = token.type == StubJsonToken::kObject ? 2 * token.count
+	                 : token.type == StubJsonToken::kArray ? token.count : 0;
+	for (int i = 0; i < values; ++i) {
+		if (!skipValue(refCon))
+			return false;
+	}
+	return true;
+}
+
+_NT_jsonParse::_NT_jsonParse(void* r, int index) : refCon(r), i(index) {}
+_NT_jsonParse::~_NT_jsonParse() {}
+
+bool _NT_jsonParse::numberOfObjectMembers(int& num) {
+	const StubJsonToken* token = takeToken(refCon, StubJsonToken::kObject);
+	if (token)
+		num = token->count;
+	return token != NULL;
+}
+
+bool _NT_jsonParse::numberOfArrayElements(int& num) {
+	const StubJsonToken* token = takeToken(refCon, StubJsonToken::kArray);
+	if (token)
+		num = token->count;
+	return token != NULL;
+}
+
+bool _NT_jsonParse::matchName(const char* name) {
+	StubJsonDocument& doc = *(StubJsonDocument*)refCon;
+	if (doc.pos >= doc.tokens.size() || doc.tokens[doc.pos].type != StubJsonToken::kName
+	    || doc.tokens[doc.pos].text != name)
+		return false;
+	++doc.pos;
+	return true;
+}
+
+bool _NT_jsonParse::skipMember() {
+	return takeToken(refCon, StubJsonToken::kName) && skipValue(refCon);
+}
+
+bool _NT_jsonParse::number(int& value) {
+	const StubJsonToken* token = takeToken(refCon, StubJsonToken::kNumber);
+	if (token)
+		value = (int)token->number;
+	return token != NULL;
+}
+
+bool _NT_jsonParse::number(float& value) {
+	const StubJsonToken* token = takeToken(refCon, StubJsonToken::kNumber);
+	if (token)
+		value = token->number;
+	return token != NULL;
+}
+
+bool _NT_jsonParse::string(const char*& str) {
+	const StubJsonToken* token = takeToken(refCon, StubJsonToken::kString);
+	if (token)
+		str = token->text.c_str();
+	return token != NULL;
+}
+
+bool _NT_jsonParse::boolean(bool& value) {
+	const StubJsonToken* token = takeToken(refCon, StubJsonToken::kBoolean);
+	if (token)
+		value = token->number != 0.0f;
+	return token != NULL;
+}
+
+bool _NT_jsonParse::null() {
+	return takeToken(refCon, StubJsonToken::kNull) != NULL;
+}
+
+// ============================================================================
+// HARNESS CONTROL
+// ============================================================================
+
+void stubSetCardMounted(bool mounted) {
+	cardMounted = mounted;
+}
+
+const int16_t* stubWavetable(int index) {
+	// Tables are synthesised once and copied on every later load
+	static std::vector<int16_t> tables[kStubNumWavetables];
+	std::vector<int16_t>& table = tables[index % kStubNumWavetables];
+	if (table.empty()) {
+		table.assign(kStubTableSize, 0);
+		synthesiseWavetable(index % kStubNumWavetables, table.data());
+	}
+	return table.data();
+}
+
+bool stubServiceWavetable() {
+	if (!pendingRequest)
+		return false;
+	_NT_wavetableRequest& request = *pendingRequest;
+	pendingRequest = NULL;
+
+	request.error = request.tableSize < (uint32_t)kStubTableSize;
+	if (!request.error) {
+		memcpy(request.table, stubWavetable(request.index), kStubTableSize * sizeof(int16_t));
+		request.numWaves = kStubNumWaves;
+		request.waveLength = kStubWaveLength;
+		request.usingMipMaps = true;
+	}
+	request.callback(request.callbackData);
+	return true;
+}
@@ -0,0 +1,46 @@
+/*
+ * Host stand-in for the distingNT firmware, for the benchmark harness.
+ *
+ * Implements the NT_* functions rainbow.cpp calls. Wavetables are
+ * synthesised on request (band-limited, mipmapped like the firmware's)
+ * and delivered when the harness calls stubServiceWavetable(), the way
+ * the firmware completes a load after NT_readWavetable() returns.
+ */
+
+#pragma once
+
+#include <distingnt/api.h>
+#include <distingnt/wav.h>
+
+#include <string>
+#include <vector>
+
+// Waves in each synthetic wavetable (2048 samples each, full mipmaps)
+static constexpr int kStubNumWaves = 64;
+static constexpr int kStubWaveLength = 2048;
+static constexpr int kStubNumWavetables = 4;
+static constexpr int kStubTableSize = 2 * kStubWaveLength * kStubNumWaves;  // all mip levels
+
+void stubSetCardMounted(bool mounted);
+
+// Synthetic table by wavetable index, in the firmware's mipmap layout
+const int16_t* stubWavetable(int index);
+
+// Completes a pending NT_readWavetable() request; returns false if none
+bool stubServiceWavetable();
+
+// Preset JSON as a flat token list: _NT_jsonStream(&document) records it,
+// _NT_jsonParse(&document, 0) reads it back from the start. Objects and
+// arrays carry their member or element counts.
+struct StubJsonToken {
+	enum Type { kObject, kArray, kName, kNumber, kString, kBoolean, kNull } type;
+	std::string text;
+	float number;
+	int count;
+};
+
+struct StubJsonDocument {
+	std::vector<StubJsonToken> tokens;
+	std::vector<size_t> open;  // containers being written
+	size_t pos;                // next token to parse
+};
@@ -12,7 +12,19 @@
 #include <math.h>
 #include <string.h>
 #include <algorithm>
+#include <atomic>
 #include <new>
+#if !defined(__arm__)
+#include <chrono>
+#endif
+#if defined(__ARM_FEATURE_DSP)
+#include <arm_acle.h>
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
 #include <distingnt/api.h>
 #include <distingnt/wav.h>
 
@@ -25,12 +37,188 @@
 static constexpr int kMaxKernelSize = 512;
 static constexpr int kKernelSizes[] = { 64, 128, 256, 512 };
 static constexpr int kNumKernelSizes = 4;
+static constexpr int kAutoResolution = kNumKernelSizes;  // Resolution enum value of "Auto"
 
-// Maximum channels supported
-static constexpr int kMaxChannels = 12;
+// Partitioned FFT convolution (overlap-save, uniform partitions)
+// Used automatically at the larger kernel sizes. Either the whole kernel
+// runs through the FFT (kFftBlockSize samples of wet latency), or the first
+// partition runs direct-form and the FFT covers the tail (no latency).
+static constexpr int kFftBlockSize = 64;
+static constexpr int kFftSize = kFftBlockSize * 2;
+static constexpr int kFftBins = kFftBlockSize + 1;
+static constexpr int kMaxPartitions = kMaxKernelSize / kFftBlockSize;
+static constexpr int kMinFftKernelSize = 256;
 
-// Wavetable buffer size (same as wavetableDemo)
+// Chain mode: kernels of up to kMaxChainSize taps, made of the waves from
+// the current one on, end to end. The first kMaxKernelSize taps run in the
+// FFT engine above, the rest in stages of longer partitions (uniform
+// within a stage). Each stage starts two of its blocks into the kernel, so
+// a completed block's transforms can be spread over the block after it,
+// a slice at every FFT block.
+static constexpr int kMaxChainSize = 8192;
+static constexpr int kChainSizes[] = { 0, 2048, 4096, 8192 };  // Chain enum values
+static constexpr int kNumChainSizes = 4;
+static constexpr int kNumChainStages = 2;
+static constexpr int kChainBlock[kNumChainStages] = { 256, 1024 };
+static constexpr int kChainStart[kNumChainStages] = { 512, 2048 };
+static constexpr int kChainEnd[kNumChainStages] = { 2048, kMaxChainSize };
+static constexpr int kMaxChainBlock = 1024;
+static constexpr int kMaxChainPartitions = 6;
+static_assert(kChainStart[0] == kMaxKernelSize && kChainStart[1] == kChainEnd[0], "stages must tile the chain");
+static_assert(kChainStart[0] == 2 * kChainBlock[0] && kChainStart[1] == 2 * kChainBlock[1], "stages need a block of slack");
+
+// Fixed-point direct form (Engine = Fixed), for the sizes below the FFT
+// engine: Q15 kernels and delay lines, two MACs per instruction into
+// 64-bit accumulators. Inputs get kFixedInputBits fractional bits (full
+// scale +-16V); kFixedAccShift bits are dropped before float conversion.
+static constexpr int kMaxFixedKernelSize = kMinFftKernelSize / 2;
+static constexpr int kFixedInputBits = 11;
+static constexpr int kFixedAccShift = 8;
+
+// Linear-phase folding: direct-form kernels that mirror within
+// kSymmetryTolerance of their peak are made exactly symmetric (or
+// antisymmetric) and convolved with one multiply per mirrored tap pair
+static constexpr float kSymmetryTolerance = 1.0f / 4096.0f;
+
+// Half-rate direct form (Engine = Half rate): a kernel whose odd taps
+// follow from its even taps by half-band interpolation, to within
+// kHalfRateTolerance of its energy (-60 dB: nearly all of it below fs/4),
+// convolves its even taps with a half-band filtered copy of the input at
+// every other delay. The kHalfRateEndTaps at either end stay exact, at
+// full rate.
+static constexpr float kHalfRateTolerance = 1.0e-6f;
+static constexpr int kHalfRateEndTaps = 8;
+static constexpr int kMinHalfRateTaps = 32;
+
+// Maximum channels supported (one per bus). The first kMaxDtcChannels
+// keep their delay lines and kernels in DTC; the rest go in SRAM, where
+// the M7's data cache holds each one's working set while it is processed.
+static constexpr int kMaxChannels = 28;
+static constexpr int kMaxDtcChannels = 12;
+static constexpr int kNumBusses = 28;
+
+// Silence detection: a channel whose input peak stays below the threshold
+// for longer than its wet tail goes idle and skips its convolution
+static constexpr float kSilenceThreshold = 1.0e-5f;  // -100 dB re 1V
+
+// Kernel banks: front (playing), fade (crossfade source or odd morph slot)
+// and one for parameterChanged() to build the next set into
+static constexpr int kNumKernelBanks = 3;
+
+// Morph CV scaling: Index offset per volt (10%/V)
+static constexpr float kMorphCvScale = 0.1f;
+
+// CPU governor (Resolution = Auto). step() cost is averaged over
+// kGovernorAverageSamples; a step down locks the size out for a backoff
+// that doubles every time it overloads again, so a ramp back up cannot
+// oscillate. Size changes crossfade (see beginSizeChange()).
+static constexpr float kGovernorAverageSamples = 4800.0f;   // ~100ms at 48kHz
+static constexpr float kGovernorHeadroom = 0.5f;            // step up only below half the budget
+static constexpr int kGovernorHoldSeconds = 1;              // settle time after a change
+static constexpr int kGovernorBackoffSeconds = 4;
+static constexpr int kGovernorMaxBackoffSeconds = 64;
+
+// Kernel size changes: partition spectra step() builds per block for a
+// direct-form size kernel the FFT engine is about to crossfade
+static constexpr int kSizeChangeSpectraPerBlock = 4;
+
+// Kernel job: share of each block's duration step() may spend building
+// kernels (at least one item runs per block). Host builds, whose clock is
+// wall time, run one item per kKernelJobHostFrames instead, so the block
+// a kernel set takes over in does not depend on the machine's load.
+static constexpr float kKernelJobShare = 0.1f;
+static constexpr int kKernelJobHostFrames = 8;
+
+// Audio-rate morph: kernel taps step() rebuilds per frame of a block as
+// Index crosses into new pairs (at least one channel's pair per block).
+// Channels over the budget keep their pair until a later block.
+static constexpr int kMorphTapsPerFrame = 128;
+
+// Cycle counter: DWT CYCCNT on the NT's Cortex-M7, the host clock in test builds
+#if defined(__arm__)
+static constexpr float kCyclesPerSecond = 600000000.0f;
+#else
+static constexpr float kCyclesPerSecond = 1000000000.0f;
+#endif
+
+// Where the convolution and output stages run (make PLACEMENT=...): copied
+// into the instance's ITC, copied into its SRAM, or in place, from the
+// memory the firmware loaded the plugin into, through the cache. Test
+// builds always run in place.
+#define RAINBOW_PLACE_FLASH 0
+#define RAINBOW_PLACE_ITC 1
+#define RAINBOW_PLACE_SRAM 2
+#ifndef RAINBOW_PLACEMENT
+#define RAINBOW_PLACEMENT RAINBOW_PLACE_ITC
+#endif
+#if defined(__arm__) && RAINBOW_PLACEMENT != RAINBOW_PLACE_FLASH
+#define RAINBOW_COPY_HOT_CODE
+#define RAINBOW_HOT __attribute__((section(".text.rainbow_hot")))
+#define RAINBOW_HOT_INLINE __attribute__((section(".text.rainbow_hot"), always_inline))
+#else
+#define RAINBOW_HOT
+#define RAINBOW_HOT_INLINE
+#endif
+
+// Host SIMD for the convolution, crossfade and output stages, by the
+// compiler's target (make SIMD=...): NEON on 64-bit ARM, AVX2 with FMA or
+// SSE4.1 on x86. The NT's Cortex-M7 has none of these and keeps the
+// scalar paths, as does a build with RAINBOW_NO_SIMD.
+#if !defined(RAINBOW_NO_SIMD)
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define RAINBOW_SIMD
+#define RAINBOW_SIMD_NEON
+#elif defined(__AVX2__) && defined(__FMA__)
+#define RAINBOW_SIMD
+#define RAINBOW_SIMD_AVX2
+#elif defined(__SSE4_1__)
+#define RAINBOW_SIMD
+#define RAINBOW_SIMD_SSE4
+#endif
+#endif
+
+// Saturation lookup (DTC): the driven and normalised curve sampled over
+// +/-kSaturationRange of driven input, linearly interpolated. Curves are
+// flat to float precision beyond the range.
+static constexpr int kSaturationTableSize = 512;  // intervals
+static constexpr float kSaturationRange = 8.0f;
+static constexpr float kAsymmetricBias = 0.3f;
+static constexpr int kSaturationFresh = 4;  // flags the middle table as newly built
+
+// Wavetable load buffer size (same as wavetableDemo), shared by all
+// instances in static DRAM. A mipmapped table of 2048-sample waves fills
+// 2 * 2048 samples per wave, so it holds up to kMaxWaves waves.
 static constexpr int kWavetableBufferSize = 256 * 2048;
+static constexpr int kMaxWaves = kWavetableBufferSize / (2 * 2048);
+
+// Loaded tables keep only the mip levels the Resolutions use: level L
+// holds kMaxWaves waves of L samples, after the smaller levels
+static inline int waveLevelsSize(int maxKernelSize) {
+	return kMaxWaves * (2 * maxKernelSize - kKernelSizes[0]);
+}
+
+// Loaded tables are shared by every instance (static DRAM), up to
+// kNumWaveSlots different ones at a time. A slot no instance has played
+// for kWaveLeaseFrames (counted across all instances' step() calls) can
+// be reused for another table.
+static constexpr int kNumWaveSlots = 4;
+static constexpr uint32_t kWaveLeaseFrames = 48000;
+static constexpr int kWaveNameSize = 32;
+
+// Normalised kernel cache (DRAM): one row per wave at the active
+// resolution, rebuilt on wavetable load and Resolution change
+static constexpr int kMaxCachedWaves = kMaxWaves;
+
+// Minimum-phase conversion FFT size (cepstral method, 4x oversampled
+// against the kernel to keep cepstral aliasing low)
+static constexpr int kMinPhaseOversample = 4;
+
+// Display: waveform and response columns. The response view plots the
+// first kernel's magnitude on a log frequency axis from kResponseLowHz to
+// Nyquist, over kResponseRangeDb below its peak.
+static constexpr int kDisplaySize = 64;
+static constexpr float kResponseLowHz = 50.0f;
+static constexpr float kResponseRangeDb = 48.0f;
 
 // ============================================================================
 // SPECIFICATIONS
@@ -38,6 +226,16 @@ static constexpr int kWavetableBufferSize = 256 * 2048;
 
 enum {
 	kSpecChannels,
+	kSpecMaxResolution,
+	kSpecMaxChain,
+	kSpecMaxEngine,
+};
+
+// Direct-form engines (the Engine parameter, up to Max Engine)
+enum {
+	kDirectFloat,
+	kDirectFixed,
+	kDirectHalfRate,  // float, with dark kernels at half rate
 };
 
 static const _NT_specification specifications[] = {
@@ -48,6 +246,27 @@ static const _NT_specification specifications[] = {
 		.def = 2,
 		.type = kNT_typeGeneric
 	},
+	{
+		.name = "Max Resolution",  // taps, rounded down to a kernel size
+		.min = kKernelSizes[0],
+		.max = kMaxKernelSize,
+		.def = kMaxKernelSize,
+		.type = kNT_typeGeneric
+	},
+	{
+		.name = "Max Chain",  // taps, rounded down to a chain length (none below Max Resolution 512)
+		.min = 0,
+		.max = kMaxChainSize,
+		.def = 0,
+		.type = kNT_typeGeneric
+	},
+	{
+		.name = "Max Engine",  // 0 Float, 1 Fixed, 2 Half rate: the lines and kernel copies it needs
+		.min = kDirectFloat,
+		.max = kDirectHalfRate,
+		.def = kDirectHalfRate,
+		.type = kNT_typeGeneric
+	},
 };
 
 // ============================================================================
@@ -63,6 +282,16 @@ enum {
 	kParamGain,
 	kParamSaturation,
 	kParamKernelSize,
+	kParamMorph,
+	kParamMorphCv,
+	kParamLatency,
+	kParamPhase,
+	kParamEnergy,
+	kParamCpuBudget,
+	kParamSaturationCurve,
+	kParamEngine,
+	kParamDisplay,
+	kParamChain,
 	
 	kNumSharedParams,
 };
@@ -77,7 +306,33 @@ enum {
 };
 
 // Kernel size enum strings
-static const char* const kernelSizeStrings[] = { "64", "128", "256", "512", NULL };
+static const char* const kernelSizeStrings[] = { "64", "128", "256", "512", "Auto", NULL };
+
+// Morph mode enum strings
+static const char* const morphStrings[] = { "Off", "Audio rate", NULL };
+
+// FFT engine latency enum strings
+static const char* const latencyStrings[] = { "Zero", "64 samples", NULL };
+
+// Kernel phase enum strings
+static const char* const phaseStrings[] = { "Original", "Minimum", NULL };
+
+// Saturation curve enum strings
+enum {
+	kCurveTanh,
+	kCurveCubic,
+	kCurveAsymmetric,
+};
+static const char* const curveStrings[] = { "Tanh", "Cubic", "Asymmetric", NULL };
+
+// Direct-form engine enum strings
+static const char* const engineStrings[] = { "Float", "Fixed", "Half rate", NULL };
+
+// Display view enum strings
+static const char* const displayStrings[] = { "Wave", "Response", NULL };
+
+// Chain length enum strings (see kChainSizes)
+static const char* const chainStrings[] = { "Off", "2048", "4096", "8192", NULL };
 
 // Base parameters (shared)
 static const _NT_parameter sharedParameters[] = {
@@ -87,7 +342,17 @@ static const _NT_parameter sharedParameters[] = {
 	{ .name = "Depth", .min = 0, .max = 100, .def = 50, .unit = kNT_unitPercent, .scaling = 0, .enumStrings = NULL },
 	{ .name = "Gain", .min = -240, .max = 240, .def = 0, .unit = kNT_unitDb, .scaling = kNT_scaling10, .enumStrings = NULL },
 	{ .name = "Saturation", .min = 0, .max = 100, .def = 0, .unit = kNT_unitPercent, .scaling = 0, .enumStrings = NULL },
-	{ .name = "Resolution", .min = 0, .max = kNumKernelSizes - 1, .def = 2, .unit = kNT_unitEnum, .scaling = 0, .enumStrings = kernelSizeStrings },
+	{ .name = "Resolution", .min = 0, .max = kAutoResolution, .def = 2, .unit = kNT_unitEnum, .scaling = 0, .enumStrings = kernelSizeStrings },
+	{ .name = "Morph", .min = 0, .max = 1, .def = 0, .unit = kNT_unitEnum, .scaling = 0, .enumStrings = morphStrings },
+	NT_PARAMETER_CV_INPUT("Morph CV", 0, 0)
+	{ .name = "Latency", .min = 0, .max = 1, .def = 0, .unit = kNT_unitEnum, .scaling = 0, .enumStrings = latencyStrings },
+	{ .name = "Phase", .min = 0, .max = 1, .def = 0, .unit = kNT_unitEnum, .scaling = 0, .enumStrings = phaseStrings },
+	{ .name = "Energy", .min = 900, .max = 1000, .def = 1000, .unit = kNT_unitPercent, .scaling = kNT_scaling10, .enumStrings = NULL },
+	{ .name = "CPU budget", .min = 5, .max = 100, .def = 25, .unit = kNT_unitPercent, .scaling = 0, .enumStrings = NULL },
+	{ .name = "Curve", .min = 0, .max = kCurveAsymmetric, .def = kCurveTanh, .unit = kNT_unitEnum, .scaling = 0, .enumStrings = curveStrings },
+	{ .name = "Engine", .min = 0, .max = kDirectHalfRate, .def = kDirectFloat, .unit = kNT_unitEnum, .scaling = 0, .enumStrings = engineStrings },
+	{ .name = "Display", .min = 0, .max = 1, .def = 0, .unit = kNT_unitEnum, .scaling = 0, .enumStrings = displayStrings },
+	{ .name = "Chain", .min = 0, .max = kNumChainSizes - 1, .def = 0, .unit = kNT_unitEnum, .scaling = 0, .enumStrings = chainStrings },
 };
 
 // Per-channel parameter template
@@ -100,8 +365,8 @@ static const _NT_parameter channelParameterTemplate[] = {
 // PARAMETER PAGES
 // ============================================================================
 
-static const uint8_t pageMain[] = { kParamWavetable, kParamIndex, kParamSpread, kParamDepth, kParamKernelSize };
-static const uint8_t pageOutput[] = { kParamGain, kParamSaturation };
+static const uint8_t pageMain[] = { kParamWavetable, kParamIndex, kParamSpread, kParamDepth, kParamKernelSize, kParamChain, kParamCpuBudget, kParamLatency, kParamEngine, kParamPhase, kParamEnergy, kParamMorph, kParamMorphCv, kParamDisplay };
+static const uint8_t pageOutput[] = { kParamGain, kParamSaturation, kParamSaturationCurve };
 
 static const _NT_parameterPage sharedPages[] = {
 	{ .name = "Colour", .numParams = ARRAY_SIZE(pageMain), .group = 0, .unused = {}, .params = pageMain },
@@ -115,27 +380,329 @@ static const _NT_parameterPage sharedPages[] = {
 // Per-channel state (in DTC for fast access)
 // Delay line is 2x size for contiguous convolution reads (no per-tap masking)
 struct ChannelState {
-	float delayLine[kMaxKernelSize * 2];
-	int writePos;
+	float* delayLine;  // 2 * max kernel size, carved from DTC or SRAM
+	int16_t* delayLineQ15;  // 2 * direct-form max size, for Engine = Fixed (NULL below Max Engine Fixed)
+	float* halfBandLine;    // 2 * direct-form max size: the input half-band interpolated, 3 samples late
+	                        // (NULL below Max Engine Half rate)
+	int writePos;           // in the float line; the shorter lines wrap it to their size
+	int silentFrames;  // since the input last reached kSilenceThreshold
+	bool idle;         // tail rung out: delay lines cleared, convolution skipped
+	bool crossfading;  // its kernel changed with the bank being crossfaded in
+	float crossfadeMix;
+};
+
+// Shortcut forms of a direct-form kernel
+enum {
+	kFormPlain,
+	kFormEven,      // folded: h[first + k] == h[taps - 1 - k]
+	kFormOdd,       // folded: h[first + k] == -h[taps - 1 - k]
+	kFormHalfRate,  // odd taps interpolated from the even ones
+	
+	kNumForms,
 };
 
-// DTC structure - performance critical data
+// What a kernel slot was built from: the clamped wave position, both
+// waves' effective lengths, the chain length, whether it may run at half
+// rate and the kernel cache it read.
+// Equal keys mean equal kernels; a cache stamp of 0 (a morph slot, a
+// preset, a cache miss, a chain whose tail is still being built) never
+// matches.
+struct KernelKey {
+	float offset;
+	uint16_t taps0, taps1;
+	uint16_t kernelSize;
+	uint16_t chainTaps;
+	bool halfRate;
+	uint32_t cacheStamp;
+};
+
+// One complete set of per-channel kernels
+struct KernelBank {
+	float* kernels[kMaxChannels];  // max kernel size each, carved from DTC or SRAM
+	int16_t* kernelsQ15[kMaxChannels];  // Q15 copies at the direct-form sizes (NULL below Max Engine Fixed)
+	float fixedScale[kMaxChannels];     // Q15 accumulator to float
+	float* halfRateEnds[kMaxChannels];  // exact first and last kHalfRateEndTaps of a half-rate kernel
+	                                    // (NULL below Max Engine Half rate)
+	uint8_t form[kMaxChannels];         // kForm* at the direct-form sizes
+	uint8_t foldStart[kMaxChannels];    // first mirrored tap (0, or 1 past a lone leading tap)
+	KernelKey keys[kMaxChannels];
+	int taps[kMaxChannels];  // effective length per kernel (zero beyond)
+	int numTaps;             // longest effective length in the bank
+	int kernelSize;
+	int chainTaps;      // chain length (0: none); the tail's spectra are in ChainChannel
+	uint32_t sequence;  // generation it was published as (the latest ready bank wins)
+	bool shared;     // every channel uses slot 0 (Spread at 0 or mono)
+	bool crossfade;  // crossfade in rather than switch at the next block
+};
+
+// Saturation curve with drive and normalisation folded in
+struct SaturationTable {
+	float scale;  // drive, in table intervals per unit of input
+	float values[kSaturationTableSize + 1];
+};
+
+// Kernel bank ownership. The producer (step()'s kernel job, whether it
+// builds a set or takes a recalled preset's) takes a free bank (or retracts a ready one step() has not picked
+// up yet), builds into it and marks it ready; step() claims ready banks at
+// a block boundary. Only step() moves banks into or out of the front,
+// fade and next states.
+enum {
+	kBankFree,
+	kBankWriting,
+	kBankReady,
+	kBankFront,
+	kBankFade,
+	kBankNext,  // a different kernel size, claimed ahead of its crossfade
+};
+
+// DTC structure - performance critical data. The delay lines and kernels
+// of the first kMaxDtcChannels follow it, sized for Max Resolution.
 struct _rainbow_DTC {
 	ChannelState channels[kMaxChannels];
 	
 	// Per-channel kernels for spread effect, with crossfade support
-	float kernels[kMaxChannels][kMaxKernelSize];
-	float newKernels[kMaxChannels][kMaxKernelSize];
-	float crossfadeMix;
-	bool crossfading;
+	KernelBank banks[kNumKernelBanks];
+	std::atomic<int> bankState[kNumKernelBanks];
+	std::atomic<uint32_t> generation;       // bumped on every publish
+	std::atomic<uint32_t> morphGeneration;  // bumped to request a morph rebuild
+	uint32_t consumedGeneration;
+	uint32_t consumedMorphGeneration;
+	int frontBank;
+	int fadeBank;      // crossfade source, odd morph slot or a bank the chain tail holds, -1 when unused
+	bool crossfading;  // some channel is (see ChannelState)
+	uint8_t chainRefs[kNumKernelBanks];  // chain delay line slots convolving with each bank
+	
+	// Audio-rate morph: the front bank holds each channel's even wave and
+	// the fade bank its odd wave; morphWave is the lower wave of the pair
+	// (-1 forces a rebuild) and morphIndex the position at the last block.
+	// morphPending is set while channels wait for their pair (see
+	// kMorphTapsPerFrame).
+	bool morph;
+	bool morphSnap;
+	bool morphPending;
+	
+	// FFT engine: run the first partition direct-form for zero latency
+	bool zeroLatency;
+	
+	// Direct form: Q15 kernels and delay lines (Engine = Fixed)
+	bool fixedPoint;
+	
+	// Offset from the hot stages to the copies step() runs (see placed())
+	intptr_t hotOffset;
+	int morphWave[kMaxChannels];
+	float morphIndex[kMaxChannels];
 	
 	// Cached parameter values
 	float depth;
 	float gain;
 	float saturation;
+	
+	// Saturation tables, triple-buffered: parameterChanged() builds into the
+	// back table and trades it for the middle one, marked fresh; step()
+	// trades its front table for a fresh middle one at a block boundary.
+	// Neither side touches a table the other holds.
+	SaturationTable saturationTables[3];
+	std::atomic<int> saturationMiddle;
+	int saturationFront;  // step()'s
+	int saturationBack;   // parameterChanged()'s
 	float spread;
+	int kernelSize;  // size step() plays at: the front bank's, or the larger while crossfading
+	int lineSize;    // delay line length (Max Resolution), whatever size plays
+	
+	// Kernel size changes: the bank taking over (-1 if none) waits while
+	// step() builds spectra for the smaller kernel if the FFT engine will
+	// play it, and, entering the FFT engine, feeds it blocks of input
+	int nextBank;
+	int nextSpectra;  // channels done
+	int warmBlocks;   // input blocks fed, -1 if the FFT engine is not entered
+	
+	// CPU governor (Resolution = Auto), run by step()
+	std::atomic<int> autoSize;  // index into kKernelSizes
+	float cpuLoad;              // averaged step() cost as a fraction of real time
+	uint32_t clock;             // samples processed
+	uint32_t holdUntil;
+	uint32_t lockedUntil[kNumKernelSizes];
+	int backoff[kNumKernelSizes];  // seconds
+};
+
+// Channels accumulated together against a shared kernel spectrum
+static constexpr int kFftGroupSize = 4;
+
+// Twiddles for a real FFT of 2 * kN samples (a complex FFT of kN points)
+template <int kN>
+struct FftTables {
+	float twiddle[kN];                // e^(-2pi i k/N), k < N/2 (interleaved)
+	float realTwiddle[(kN + 1) * 2];  // e^(-pi i k/N), k <= N (interleaved)
+	uint16_t bitReverse[kN];
+};
+
+// FFT twiddles, scratch and block position shared by all channels (in SRAM)
+// All channels advance through FFT blocks in lockstep.
+struct FftEngine : FftTables<kFftBlockSize> {
+	float acc[kFftGroupSize][kFftBins * 2];
+	int fill;
+	int fdlPos;
+	int headPartitions;  // leading partitions left to the direct-form head (0 or 1, see bankHead())
+#ifdef RAINBOW_PROFILE
+	uint32_t secondPassCycles;  // spent on the second bank by the last fftProcessBlock
+#endif
+};
+
+// Per-channel partitioned convolution state (in SRAM)
+// Spectra are stored as kFftBins interleaved re/im pairs.
+struct FftChannel {
+	float spectra[kNumKernelBanks][kMaxPartitions][kFftBins * 2];  // per kernel bank
+	float fdl[kMaxPartitions][kFftBins * 2];         // frequency-domain delay line
+	float input[kFftSize];                           // last two input blocks
+	float output[kFftBlockSize];                     // wet block being played out
+	float outputNew[kFftBlockSize];                  // same, through the second bank
+	bool newValid;
+	bool idle;        // as in ChannelState; block processing skips the channel
+	bool secondPass;  // the second bank runs for it (crossfading or morphing)
+};
+
+// Per-channel chain tail state (in DRAM). Each stage keeps partition
+// spectra per kernel bank and a frequency-domain delay line, at
+// kChainBlock + 1 interleaved bins (and room for a full block of samples)
+// per partition. The input and output rings are shared by the stages.
+struct ChainChannel {
+	float* spectra[kNumChainStages][kNumKernelBanks];
+	float* fdl[kNumChainStages];
+	float* input;   // recent input, by input time
+	float* output;  // tail output still to be played, by output time
+};
+
+// Chain tail engine (in DRAM). A completed stage block is transformed,
+// accumulated and transformed back for every channel in work units spread
+// over the following block. Each delay line slot convolves with the bank
+// that was in front when its block completed, so a new kernel takes over
+// from the new input on while the old one rings out on the old; the slots
+// count their banks in chainRefs, and step() keeps a bank with references
+// (as the fade bank, once it leaves the front).
+struct ChainEngine {
+	FftTables<kChainBlock[0]> tables0;
+	FftTables<kChainBlock[1]> tables1;
+	float acc[(kMaxChainBlock + 1) * 2];
+	float y[kMaxChainBlock * 2];
+	uint32_t clock;    // input samples, advanced at FFT block boundaries
+	uint32_t readPos;  // output time of the next tail sample to play
+	uint32_t written;  // output time the last tail block written ends at
+	uint32_t ringMask;
+	int partitions[kNumChainStages];         // delay line slots (at Max Chain)
+	int fdlPos[kNumChainStages];
+	int done[kNumChainStages];               // work units run for the block that ended last
+	uint32_t blockEnd[kNumChainStages];      // input time it ended at
+	int8_t slotBank[kNumChainStages][kMaxChainPartitions];  // -1 when the slot is not convolved
+};
+
+#ifdef RAINBOW_PROFILE
+// Hot-path timing (build with PROFILE=1). Audio phases are in cycles per
+// sample, kernel builds in cycles per block they run in, and wavetable
+// loads in cycles per call.
+enum {
+	kProfileStep,
+	kProfileConvolve,
+	kProfileSecondPass,  // crossfade or morph bank
+	kProfileMix,         // dry/wet mix, saturation and gain
+	kProfileHandoff,     // bank pickup and morph slot rebuilds
+	kProfileKernelBuild,
+	kProfileWavetableLoad,
+	
+	kNumProfileStats,
+};
+
+struct ProfileStat {
+	float min;
+	float avg;
+	float max;
+	uint32_t count;
+};
+#endif
+
+enum {
+	kSlotEmpty,
+	kSlotLoading,
+	kSlotReady,
+};
+
+// One loaded wavetable, shared by the instances playing it: its mip
+// levels up to kMaxKernelSize and wave count (0 when the table has no mip
+// levels to use). Instances renew lastUse from step() while it is their
+// front table; generation changes whenever the slot is taken for a load,
+// so a reference older than that is known to be stale.
+struct WaveSlot {
+	int16_t* levels;  // see waveLevelsSize
+	int numWaves;
+	uint32_t index;            // wavetable it holds
+	char name[kWaveNameSize];  // and its name at load (another card renumbers the tables)
+	std::atomic<int> state;
+	std::atomic<uint32_t> generation;
+	std::atomic<uint32_t> lastUse;
+};
+
+// Kernel job requests (flags, OR-ed together until step() takes them)
+enum {
+	kJobKernels = 1,    // build a bank for the current parameters
+	kJobCrossfade = 2,  // crossfade into it
+	kJobMeasure = 4,    // re-measure the cached waves (Energy)
+	kJobCache = 8,      // rebuild the kernel cache (table, Resolution, Phase)
+	kJobPreset = 16,    // play the kernels deserialise() staged
+};
+
+enum {
+	kStageIdle,
+	kStageCache,     // one cache row per item
+	kStageMeasure,   // one cached wave per item
+	kStageKernels,   // one bank slot per item
+	kStageResponse,  // the display's response of the set just published
+	kStagePreset,    // the staged preset kernels into a bank, then one slot per item
+};
+
+// Kernel construction in progress, owned by step()
+struct KernelJob {
+	int flags;       // requests taken and not yet completed
+	int stage;
+	int next;        // next item of the stage
+	int numItems;
+	int kernelSize;  // size the stage builds at
+	int bank;        // bank being built into, -1 when none is held
+	int published;   // bank last published (the response stage reads it)
+	KernelKey chainKey;  // key of the chain being built into a slot, set once its tail is complete
+};
+
+// Preset staging ownership: deserialise() fills an empty staging area (or
+// retracts a ready one the job has not taken yet), and step()'s kernel job
+// copies a ready one into a bank within a single block
+enum {
+	kPresetEmpty,
+	kPresetWriting,
+	kPresetReady,
+	kPresetTaking,
+};
+
+// Kernels of a recalled preset, as stored: Q15 at a power-of-two scale
+// per kernel
+struct PresetKernels {
+	int16_t* taps;  // numChannels x Max Resolution (DRAM)
+	int numTaps[kMaxChannels];
+	int shift[kMaxChannels];
 	int kernelSize;
-	int kernelMask;
+	bool shared;
+	std::atomic<int> state;
+};
+
+// What draw() last rendered, and what it was rendered from. The name is
+// looked up again only when Wavetable or the front table changes, and the
+// waveform only when Index does too.
+struct DisplayCache {
+	const WaveSlot* slot;  // front table at the last render
+	uint32_t generation;
+	int wavetable;         // Wavetable and Index at the last render, -1 forces one
+	int index;
+	bool cardMounted;
+	bool hasName;
+	char name[kWaveNameSize];
+	float waveY[kDisplaySize];  // waveform polyline
 };
 
 // Main algorithm structure
@@ -156,113 +723,3094 @@ struct _rainbowAlgorithm : public _NT_algorithm {
 	
 	// Memory pointers
 	_rainbow_DTC* dtc;
-	int16_t* wavetableBuffer;
+	float* kernelCache;
+	float* phaseWork;  // minimum-phase FFT scratch (DRAM)
+	FftEngine* fft;
+	FftChannel* fftChannels;
+	ChainEngine* chain;  // NULL without Max Chain
+	ChainChannel* chainChannels;
 	
-	// Wavetable request
+	// Wavetable request. A load (or a table already in a shared slot) is
+	// offered to step(), which adopts it as the front slot at a block
+	// boundary; everything else reads the front slot only.
 	_NT_wavetableRequest request;
+	WaveSlot* loadSlot;                 // slot the request fills
+	std::atomic<WaveSlot*> offeredSlot;
+	uint32_t offeredGeneration;
+	std::atomic<WaveSlot*> frontSlot;
+	uint32_t frontGeneration;
+	bool loadError;  // the last load failed (the previous table plays on)
 	
 	// State
 	int numChannels;
+	int maxSizeIndex;  // largest usable index into kKernelSizes (Max Resolution)
+	int maxChainIndex; // largest usable index into kChainSizes (Max Chain)
+	int maxEngine;     // highest usable kDirect* engine (Max Engine)
 	bool cardMounted;
 	bool awaitingCallback;
+	bool loadWaiting;  // a selection is waiting for the load buffer or the current load; step() retries
+	bool slotWaiting;  // ... or for a free wave slot (the front one stops renewing its lease meanwhile)
 	bool wavetableLoaded;
 	
+	// Kernel size new sets are built at: the Resolution parameter, or the
+	// governor's choice in Auto (which step() may change); always
+	// kMaxKernelSize for a chain
+	std::atomic<int> kernelSize;
+	
+	// Row size the kernel cache holds (0 while it is being rebuilt)
+	std::atomic<int> cacheKernelSize;
+	int cacheNumWaves;
+	uint16_t cacheTaps[kMaxCachedWaves];  // effective length of each cached wave
+	float cacheSums[kMaxCachedWaves];     // L1 sum of each cached wave
+	uint32_t cacheStamp;                  // bumped whenever the rows change (never 0)
+	
+	// Kernel construction: parameterChanged() and the wavetable callback
+	// post requests, step() builds them (see Kernel job)
+	std::atomic<int> jobRequest;
+	KernelJob job;
+	PresetKernels preset;
+	
+	// Magnitude response of the first kernel of the last set built, in
+	// display rows (0 at the peak, 1 at the floor); the job fills the copy
+	// draw() isn't reading and flips responseFront (-1 while there is none)
+	float response[2][kDisplaySize];
+	std::atomic<int> responseFront;
+	DisplayCache display;  // draw() only
+	
 	// Current wavetable info
 	int currentWaveIndex;
 	float currentIndexParam;
+	
+#ifdef RAINBOW_PROFILE
+	ProfileStat profile[kNumProfileStats];
+#endif
+};
+
+// ============================================================================
+// CYCLE COUNTER
+// ============================================================================
+
+static void enableCycleCounter() {
+#if defined(__arm__)
+	volatile uint32_t* demcr = (volatile uint32_t*)0xE000EDFC;
+	volatile uint32_t* dwtCtrl = (volatile uint32_t*)0xE0001000;
+	*demcr |= 1u << 24;  // TRCENA
+	*dwtCtrl |= 1u;      // CYCCNTENA
+#endif
+}
+
+RAINBOW_HOT_INLINE static inline uint32_t readCycleCounter() {
+#if defined(__arm__)
+	return *(volatile uint32_t*)0xE0001004;  // DWT CYCCNT
+#else
+	return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+#ifdef RAINBOW_PROFILE
+#define PROFILE_START(t) const uint32_t t = readCycleCounter()
+#define PROFILE_ADD(acc, t) ((acc) += readCycleCounter() - (t))
+#define PROFILE_RECORD(pThis, stat, t) profileRecord(&(pThis)->profile[stat], readCycleCounter() - (t))
+
+static void profileRecord(ProfileStat* p, float value) {
+	if (p->count == 0) {
+		p->min = p->avg = p->max = value;
+	} else {
+		p->min = std::min(p->min, value);
+		p->max = std::max(p->max, value);
+		p->avg += (value - p->avg) * (p->count < 64 ? 1.0f / (p->count + 1) : 1.0f / 64);
+	}
+	++p->count;
+}
+#else
+#define PROFILE_START(t)
+#define PROFILE_ADD(acc, t)
+#define PROFILE_RECORD(pThis, stat, t)
+#endif
+
+// ============================================================================
+// HOT CODE PLACEMENT
+// ============================================================================
+//
+// The per-sample stages and the FFT engine's multiply-accumulate are
+// compiled into one section, bracketed by the two labels below (the end
+// label sits in a later subsection, so it follows everything the compiler
+// puts there). construct() copies the section into ITC or SRAM, and step()
+// calls the copies at a fixed offset from the originals. Thumb branches
+// and literal loads are PC-relative, so the copy runs as-is as long as
+// code in the section calls nothing outside it: its helpers are forced
+// inline, the hardware build keeps loops from becoming memcpy() calls, and
+// the Makefile fails the build on a branch that leaves the section.
+// GCC places implicit template instantiations by their own names rather
+// than by the template's section, so each specialisation the stage tables
+// use is instantiated explicitly.
+
+#ifdef RAINBOW_COPY_HOT_CODE
+extern "C" const char rainbowHotStart[];
+extern "C" const char rainbowHotEnd[];
+asm(".pushsection .text.rainbow_hot,\"ax\",%progbits\n"
+    "rainbowHotStart:\n"
+    ".subsection 1\n"
+    "rainbowHotEnd:\n"
+    ".popsection\n");
+
+// Bytes to request for the copy, with slack to keep the original's alignment
+static size_t hotCodeSize() {
+	return (size_t)(rainbowHotEnd - rainbowHotStart) + 8;
+}
+
+// Copies the section into mem and returns the offset from each original
+// function to its copy. The copy starts at the same address mod 8, so
+// aligned literal pools stay aligned; it is then made visible to
+// instruction fetch (SRAM is cached, ITC is not).
+static intptr_t placeHotCode(uint8_t* mem) {
+	const size_t size = rainbowHotEnd - rainbowHotStart;
+	uint8_t* dest = mem + (((uintptr_t)rainbowHotStart - (uintptr_t)mem) & 7);
+	memcpy(dest, rainbowHotStart, size);
+	
+	volatile uint32_t* dccmvac = (volatile uint32_t*)0xE000EF68;  // clean D-cache line to PoC
+	volatile uint32_t* iciallu = (volatile uint32_t*)0xE000EF50;  // invalidate I-cache
+	const uintptr_t end = (uintptr_t)dest + size;
+	asm volatile("dsb" ::: "memory");
+	for (uintptr_t line = (uintptr_t)dest & ~(uintptr_t)31; line < end; line += 32) {
+		*dccmvac = line;
+	}
+	asm volatile("dsb" ::: "memory");
+	*iciallu = 0;
+	asm volatile("dsb\n\tisb" ::: "memory");
+	return (intptr_t)((uintptr_t)dest - (uintptr_t)rainbowHotStart);
+}
+#endif
+
+// A hot function at its placed copy. The offset is even, so the Thumb bit
+// carries over.
+template <typename Fn>
+static inline Fn placed(Fn fn, intptr_t hotOffset) {
+	return (Fn)((uintptr_t)fn + hotOffset);
+}
+
+// ============================================================================
+// HOST SIMD
+// ============================================================================
+//
+// Four-lane float vectors for the test build's stages (see RAINBOW_SIMD).
+// They vectorise across four consecutive outputs or two complex bins, so
+// each lane runs the scalar path's arithmetic in the same order. Where
+// that uses fmaf(), NEON and AVX2 fuse it too and give identical results;
+// SSE4.1 rounds the product separately.
+
+#ifdef RAINBOW_SIMD
+#if defined(RAINBOW_SIMD_NEON)
+typedef float32x4_t Vec4;
+
+static inline Vec4 v4load(const float* p) { return vld1q_f32(p); }
+static inline void v4store(float* p, Vec4 v) { vst1q_f32(p, v); }
+static inline Vec4 v4splat(float x) { return vdupq_n_f32(x); }
+static inline Vec4 v4add(Vec4 a, Vec4 b) { return vaddq_f32(a, b); }
+static inline Vec4 v4sub(Vec4 a, Vec4 b) { return vsubq_f32(a, b); }
+static inline Vec4 v4mul(Vec4 a, Vec4 b) { return vmulq_f32(a, b); }
+static inline Vec4 v4min(Vec4 a, Vec4 b) { return vminq_f32(a, b); }
+static inline Vec4 v4max(Vec4 a, Vec4 b) { return vmaxq_f32(a, b); }
+
+// a * b + c, as fmaf()
+static inline Vec4 v4fma(Vec4 a, Vec4 b, Vec4 c) { return vfmaq_f32(c, a, b); }
+
+// a * b[kLane] + c
+template <int kLane>
+static inline Vec4 v4fmaLane(Vec4 a, Vec4 b, Vec4 c) { return vfmaq_laneq_f32(c, a, b, kLane); }
+
+// Two interleaved complex coefficients as v4complexMul() takes them
+static inline void v4complexSplit(Vec4 h, Vec4& hr, Vec4& hi) {
+	static const float kSigns[4] = { -1.0f, 1.0f, -1.0f, 1.0f };
+	hr = vtrn1q_f32(h, h);
+	hi = vmulq_f32(vtrn2q_f32(h, h), vld1q_f32(kSigns));
+}
+
+// x * h for two interleaved complex bins
+static inline Vec4 v4complexMul(Vec4 x, Vec4 hr, Vec4 hi) {
+	return vaddq_f32(vmulq_f32(x, hr), vmulq_f32(vrev64q_f32(x), hi));
+}
+
+// Linear interpolation in table at pos, as softSaturate()
+static inline Vec4 v4lerpTable(const float* table, Vec4 pos, int last) {
+	const int32x4_t i = vminq_s32(vcvtq_s32_f32(pos), vdupq_n_s32(last));
+	int32_t idx[4];
+	vst1q_s32(idx, i);
+	float lo[4], hi[4];
+	for (int j = 0; j < 4; ++j) {
+		lo[j] = table[idx[j]];
+		hi[j] = table[idx[j] + 1];
+	}
+	const Vec4 l = vld1q_f32(lo);
+	return vfmaq_f32(l, vsubq_f32(pos, vcvtq_f32_s32(i)), vsubq_f32(vld1q_f32(hi), l));
+}
+#else
+typedef __m128 Vec4;
+
+static inline Vec4 v4load(const float* p) { return _mm_loadu_ps(p); }
+static inline void v4store(float* p, Vec4 v) { _mm_storeu_ps(p, v); }
+static inline Vec4 v4splat(float x) { return _mm_set1_ps(x); }
+static inline Vec4 v4add(Vec4 a, Vec4 b) { return _mm_add_ps(a, b); }
+static inline Vec4 v4sub(Vec4 a, Vec4 b) { return _mm_sub_ps(a, b); }
+static inline Vec4 v4mul(Vec4 a, Vec4 b) { return _mm_mul_ps(a, b); }
+static inline Vec4 v4min(Vec4 a, Vec4 b) { return _mm_min_ps(a, b); }
+static inline Vec4 v4max(Vec4 a, Vec4 b) { return _mm_max_ps(a, b); }
+
+// a * b + c, as fmaf() (SSE4.1: rounded twice)
+static inline Vec4 v4fma(Vec4 a, Vec4 b, Vec4 c) {
+#if defined(RAINBOW_SIMD_AVX2)
+	return _mm_fmadd_ps(a, b, c);
+#else
+	return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+
+// a * b[kLane] + c
+template <int kLane>
+static inline Vec4 v4fmaLane(Vec4 a, Vec4 b, Vec4 c) {
+	return v4fma(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(kLane, kLane, kLane, kLane)), c);
+}
+
+// Two interleaved complex coefficients as v4complexMul() takes them
+static inline void v4complexSplit(Vec4 h, Vec4& hr, Vec4& hi) {
+	hr = _mm_moveldup_ps(h);
+	hi = _mm_movehdup_ps(h);
+}
+
+// x * h for two interleaved complex bins
+static inline Vec4 v4complexMul(Vec4 x, Vec4 hr, Vec4 hi) {
+	return _mm_addsub_ps(_mm_mul_ps(x, hr), _mm_mul_ps(_mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1)), hi));
+}
+
+// Linear interpolation in table at pos, as softSaturate()
+static inline Vec4 v4lerpTable(const float* table, Vec4 pos, int last) {
+	const __m128i i = _mm_min_epi32(_mm_cvttps_epi32(pos), _mm_set1_epi32(last));
+#if defined(RAINBOW_SIMD_AVX2)
+	const Vec4 lo = _mm_i32gather_ps(table, i, 4);
+	const Vec4 hi = _mm_i32gather_ps(table + 1, i, 4);
+#else
+	const int i0 = _mm_extract_epi32(i, 0), i1 = _mm_extract_epi32(i, 1);
+	const int i2 = _mm_extract_epi32(i, 2), i3 = _mm_extract_epi32(i, 3);
+	const Vec4 lo = _mm_setr_ps(table[i0], table[i1], table[i2], table[i3]);
+	const Vec4 hi = _mm_setr_ps(table[i0 + 1], table[i1 + 1], table[i2 + 1], table[i3 + 1]);
+#endif
+	return v4fma(_mm_sub_ps(pos, _mm_cvtepi32_ps(i)), _mm_sub_ps(hi, lo), lo);
+}
+#endif
+
+static inline Vec4 v4zero() { return v4splat(0.0f); }
+#endif
+
+// ============================================================================
+// FFT CONVOLUTION
+// ============================================================================
+
+template <int kN>
+static void initFftTables(FftTables<kN>* t) {
+	constexpr float kPi = 3.14159265358979f;
+	for (int k = 0; k < kN / 2; ++k) {
+		float a = -2.0f * kPi * k / kN;
+		t->twiddle[2 * k] = cosf(a);
+		t->twiddle[2 * k + 1] = sinf(a);
+	}
+	for (int k = 0; k <= kN; ++k) {
+		float a = -kPi * k / kN;
+		t->realTwiddle[2 * k] = cosf(a);
+		t->realTwiddle[2 * k + 1] = sinf(a);
+	}
+	int bits = 0;
+	while ((1 << bits) < kN) ++bits;
+	for (int i = 0; i < kN; ++i) {
+		int r = 0;
+		for (int b = 0; b < bits; ++b) {
+			if (i & (1 << b)) r |= 1 << (bits - 1 - b);
+		}
+		t->bitReverse[i] = r;
+	}
+}
+
+// In-place radix-2 complex FFT of kN interleaved points (unscaled)
+template <int kN>
+static void fftComplex(const FftTables<kN>* t, float* data, bool inverse) {
+	constexpr int n = kN;
+	for (int i = 0; i < n; ++i) {
+		int j = t->bitReverse[i];
+		if (j > i) {
+			std::swap(data[2 * i], data[2 * j]);
+			std::swap(data[2 * i + 1], data[2 * j + 1]);
+		}
+	}
+	const float sign = inverse ? -1.0f : 1.0f;
+	for (int size = 2; size <= n; size <<= 1) {
+		const int half = size >> 1;
+		const int stride = n / size;
+		for (int i = 0; i < n; i += size) {
+			for (int j = 0; j < half; ++j) {
+				const float wr = t->twiddle[2 * j * stride];
+				const float wi = sign * t->twiddle[2 * j * stride + 1];
+				float* a = &data[2 * (i + j)];
+				float* b = &data[2 * (i + j + half)];
+				const float tr = wr * b[0] - wi * b[1];
+				const float ti = wr * b[1] + wi * b[0];
+				b[0] = a[0] - tr;
+				b[1] = a[1] - ti;
+				a[0] += tr;
+				a[1] += ti;
+			}
+		}
+	}
+}
+
+// One bin of the real FFT from the complex FFT's bins k0 and k1 (m - k)
+template <int kN>
+static inline void realFftBin(const FftTables<kN>* t, int k, float zr, float zi, float mr, float mi, float* out) {
+	const float er = 0.5f * (zr + mr), ei = 0.5f * (zi + mi);
+	const float orr = 0.5f * (zi - mi), oi = -0.5f * (zr - mr);
+	const float wr = t->realTwiddle[2 * k], wi = t->realTwiddle[2 * k + 1];
+	out[0] = er + wr * orr - wi * oi;
+	out[1] = ei + wr * oi + wi * orr;
+}
+
+// Real FFT of 2 * kN samples to kN + 1 complex bins, in place: data holds
+// the samples and has room for the two extra floats of the last bin.
+// Bins k and kN - k are computed together from the same two inputs.
+template <int kN>
+static void fftRealInPlace(const FftTables<kN>* t, float* data) {
+	constexpr int m = kN;
+	fftComplex(t, data, false);
+	
+	const float zr = data[0], zi = data[1];
+	realFftBin(t, 0, zr, zi, zr, -zi, &data[0]);
+	realFftBin(t, m, zr, zi, zr, -zi, &data[2 * m]);
+	for (int k = 1; k <= m / 2; ++k) {
+		const float ar = data[2 * k], ai = data[2 * k + 1];
+		const float br = data[2 * (m - k)], bi = data[2 * (m - k) + 1];
+		realFftBin(t, k, ar, ai, br, -bi, &data[2 * k]);
+		if (k != m - k) realFftBin(t, m - k, br, bi, ar, -ai, &data[2 * (m - k)]);
+	}
+}
+
+// Real FFT of kFftSize samples to kFftBins complex bins
+static void fftReal(const FftEngine* t, const float* in, float* out) {
+	memcpy(out, in, kFftSize * sizeof(float));
+	fftRealInPlace(t, out);
+}
+
+// Inverse real FFT of kN + 1 bins to 2 * kN samples
+// Scaled by kN; the 1/kN is folded into the kernel spectra.
+template <int kN>
+static void ifftReal(const FftTables<kN>* t, const float* in, float* out) {
+	constexpr int m = kN;
+	float* z = out;  // transformed in place
+	
+	for (int k = 0; k < m; ++k) {
+		const float xr = in[2 * k], xi = in[2 * k + 1];
+		const float mr = in[2 * (m - k)], mi = -in[2 * (m - k) + 1];
+		const float er = 0.5f * (xr + mr), ei = 0.5f * (xi + mi);
+		const float dr = 0.5f * (xr - mr), di = 0.5f * (xi - mi);
+		const float wr = t->realTwiddle[2 * k], wi = t->realTwiddle[2 * k + 1];
+		const float orr = dr * wr + di * wi;
+		const float oi = di * wr - dr * wi;
+		z[2 * k] = er - oi;
+		z[2 * k + 1] = ei + orr;
+	}
+	fftComplex(t, z, true);
+}
+
+// Transform a time-domain kernel into zero-padded partition spectra
+static void buildSpectra(FftEngine* t, const float* kernel, int kernelSize,
+                         float spectra[][kFftBins * 2]) {
+	constexpr float kScale = 1.0f / kFftBlockSize;
+	float padded[kFftSize];
+	const int numPartitions = kernelSize / kFftBlockSize;
+	
+	for (int p = 0; p < numPartitions; ++p) {
+		for (int i = 0; i < kFftBlockSize; ++i) {
+			padded[i] = kernel[p * kFftBlockSize + i] * kScale;
+			padded[kFftBlockSize + i] = 0.0f;
+		}
+		fftReal(t, padded, spectra[p]);
+	}
+}
+
+static void resetFft(FftEngine* e, FftChannel* channels, int numChannels) {
+	for (int ch = 0; ch < numChannels; ++ch) {
+		FftChannel* fc = &channels[ch];
+		memset(fc->fdl, 0, sizeof(fc->fdl));
+		memset(fc->input, 0, sizeof(fc->input));
+		memset(fc->output, 0, sizeof(fc->output));
+		memset(fc->outputNew, 0, sizeof(fc->outputNew));
+		fc->newValid = false;
+	}
+	e->fill = 0;
+	e->fdlPos = 0;
+}
+
+// Multiply-accumulate kGroup channels' delay lines against one set of
+// partition spectra. Bins are the outer loop so the accumulators stay in
+// registers, and each coefficient is loaded once for the whole group.
+template <int kGroup>
+RAINBOW_HOT static void fftAccumulate(const FftChannel* const* chans, const float (*spectra)[kFftBins * 2],
+                                      int numPartitions, int fdlPos, float (*acc)[kFftBins * 2]) {
+	int k = 0;
+#ifdef RAINBOW_SIMD
+	// Two bins at a time, leaving the Nyquist bin to the loop below
+	for (; k + 4 <= kFftBins * 2; k += 4) {
+		Vec4 a[kGroup];
+		for (int c = 0; c < kGroup; ++c) a[c] = v4zero();
+		for (int p = 0; p < numPartitions; ++p) {
+			const int slot = (fdlPos - p) & (kMaxPartitions - 1);
+			Vec4 hr, hi;
+			v4complexSplit(v4load(&spectra[p][k]), hr, hi);
+			for (int c = 0; c < kGroup; ++c) {
+				a[c] = v4add(a[c], v4complexMul(v4load(&chans[c]->fdl[slot][k]), hr, hi));
+			}
+		}
+		for (int c = 0; c < kGroup; ++c) v4store(&acc[c][k], a[c]);
+	}
+#endif
+	for (; k < kFftBins * 2; k += 2) {
+		float ar[kGroup] = {}, ai[kGroup] = {};
+		for (int p = 0; p < numPartitions; ++p) {
+			const int slot = (fdlPos - p) & (kMaxPartitions - 1);
+			const float hr = spectra[p][k], hi = spectra[p][k + 1];
+			for (int c = 0; c < kGroup; ++c) {
+				const float* x = &chans[c]->fdl[slot][k];
+				ar[c] += x[0] * hr - x[1] * hi;
+				ai[c] += x[0] * hi + x[1] * hr;
+			}
+		}
+		for (int c = 0; c < kGroup; ++c) {
+			acc[c][k] = ar[c];
+			acc[c][k + 1] = ai[c];
+		}
+	}
+}
+
+typedef void (*FftAccumulateFn)(const FftChannel* const* chans, const float (*spectra)[kFftBins * 2],
+                                int numPartitions, int fdlPos, float (*acc)[kFftBins * 2]);
+
+template RAINBOW_HOT void fftAccumulate<1>(const FftChannel* const*, const float (*)[kFftBins * 2], int, int, float (*)[kFftBins * 2]);
+template RAINBOW_HOT void fftAccumulate<2>(const FftChannel* const*, const float (*)[kFftBins * 2], int, int, float (*)[kFftBins * 2]);
+template RAINBOW_HOT void fftAccumulate<3>(const FftChannel* const*, const float (*)[kFftBins * 2], int, int, float (*)[kFftBins * 2]);
+template RAINBOW_HOT void fftAccumulate<4>(const FftChannel* const*, const float (*)[kFftBins * 2], int, int, float (*)[kFftBins * 2]);
+
+// By group size - 1
+static const FftAccumulateFn fftAccumulators[kFftGroupSize] = {
+	fftAccumulate<1>, fftAccumulate<2>, fftAccumulate<3>, fftAccumulate<4>,
+};
+
+// Convolve one bank of spectra for every channel (only those marked
+// secondPass if marked) and transform the results back into the output
+// blocks (outputNew for the second bank). With a shared kernel, channels
+// are grouped against channel 0's spectra.
+//
+// With a direct-form head, partition p + 1 is paired with the delay line
+// slot that partition p would use: the result is then the tail's share of
+// the *next* block, which is played without any added latency.
+static void fftConvolveBank(FftEngine* e, FftChannel* channels, int numChannels,
+                            int numPartitions, int head, int fdlPos, int bank, bool shared, bool second,
+                            bool marked, intptr_t hotOffset) {
+	const FftChannel* group[kFftGroupSize];
+	float y[kFftSize];
+	head = std::min(head, numPartitions);
+	
+	int members[kFftGroupSize];
+	
+	// Idle channels are left out; their output blocks stay silent. So are
+	// unmarked channels (the second bank does not run for them).
+	for (int ch = 0; ch < numChannels; ) {
+		const int limit = shared ? kFftGroupSize : 1;
+		int count = 0;
+		for (; ch < numChannels && count < limit; ++ch) {
+			if (!channels[ch].idle && (!marked || channels[ch].secondPass)) members[count++] = ch;
+		}
+		if (count == 0)
+			continue;
+		const FftChannel* owner = &channels[shared ? 0 : members[0]];
+		for (int c = 0; c < count; ++c) group[c] = &channels[members[c]];
+		
+		placed(fftAccumulators[count - 1], hotOffset)(group, owner->spectra[bank] + head,
+		                                              numPartitions - head, fdlPos, e->acc);
+		
+		// Overlap-save: the second half of the circular result is valid
+		for (int c = 0; c < count; ++c) {
+			FftChannel* fc = &channels[members[c]];
+			ifftReal(e, e->acc[c], y);
+			memcpy(second ? fc->outputNew : fc->output, y + kFftBlockSize,
+			       kFftBlockSize * sizeof(float));
+		}
+	}
+}
+
+// Process one full input block on every channel: transform each input,
+// accumulate against the kernel partitions through the delay line and
+// transform back. The second bank (crossfade or morph) is optional, and
+// runs only for channels marked secondPass.
+// Each bank only runs the partitions its effective length reaches, less
+// its direct-form head. hotOffset places the multiply-accumulate (see
+// placed()).
+static void fftProcessBlock(FftEngine* e, FftChannel* channels, int numChannels,
+                            int bank, bool shared, int numPartitions, int head,
+                            int secondBank, bool secondShared, int secondPartitions, int secondHead,
+                            intptr_t hotOffset) {
+	for (int ch = 0; ch < numChannels; ++ch) {
+		FftChannel* fc = &channels[ch];
+		if (!fc->idle) fftReal(e, fc->input, fc->fdl[e->fdlPos]);
+	}
+	
+	fftConvolveBank(e, channels, numChannels, numPartitions, head, e->fdlPos, bank, shared, false, false, hotOffset);
+#ifdef RAINBOW_PROFILE
+	e->secondPassCycles = 0;
+#endif
+	if (secondBank >= 0) {
+		PROFILE_START(t);
+		fftConvolveBank(e, channels, numChannels, secondPartitions, secondHead, e->fdlPos, secondBank, secondShared,
+		                true, true, hotOffset);
+		PROFILE_ADD(e->secondPassCycles, t);
+	}
+	
+	for (int ch = 0; ch < numChannels; ++ch) {
+		FftChannel* fc = &channels[ch];
+		fc->newValid = secondBank >= 0 && fc->secondPass;
+		if (!fc->idle) memcpy(fc->input, fc->input + kFftBlockSize, kFftBlockSize * sizeof(float));
+	}
+	e->fdlPos = (e->fdlPos + 1) & (kMaxPartitions - 1);
+}
+
+// Chain tail
+//
+// Stage s convolves taps [kChainStart[s], kChainEnd[s]) of a chain kernel
+// in partitions of kChainBlock[s]: the sum over each delay line slot's
+// spectrum times its partition's, transformed back, is the stage's output
+// over [end + B, end + 2B) for a block ending at input time end. Those
+// samples are first played a block after the block ends, so its work is
+// spread over that block.
+
+// Partitions of stage s within a chain length
+static inline int chainPartitions(int chainTaps, int s) {
+	return std::max(0, std::min(chainTaps, kChainEnd[s]) - kChainStart[s]) / kChainBlock[s];
+}
+
+// Input and output ring size: the longest stage's two blocks of input,
+// the block its work is spread over and a block of output slack
+static inline int chainRingSize(int maxChain) {
+	return 4 * (chainPartitions(maxChain, 1) > 0 ? kChainBlock[1] : kChainBlock[0]);
+}
+
+static void clearChainChannel(const ChainEngine* c, ChainChannel* cc) {
+	for (int s = 0; s < kNumChainStages; ++s) {
+		memset(cc->fdl[s], 0, c->partitions[s] * (kChainBlock[s] + 1) * 2 * sizeof(float));
+	}
+	memset(cc->input, 0, (c->ringMask + 1) * sizeof(float));
+	memset(cc->output, 0, (c->ringMask + 1) * sizeof(float));
+}
+
+// Stop convolving: every slot lets go of its bank. Output already
+// computed still plays out.
+static void releaseChain(ChainEngine* c, _rainbow_DTC* dtc, int numChannels) {
+	for (int s = 0; s < kNumChainStages; ++s) {
+		for (int p = 0; p < kMaxChainPartitions; ++p) {
+			c->slotBank[s][p] = -1;
+		}
+		c->done[s] = 2 * numChannels;
+	}
+	memset(dtc->chainRefs, 0, sizeof(dtc->chainRefs));
+}
+
+// A stage block ended at input time end: the oldest slot takes the new
+// block for the front bank (if it has a chain that reaches the stage),
+// and slots drop banks that have no partition at their lag. Returns false
+// if the stage has nothing to convolve.
+static bool chainEndBlock(ChainEngine* c, _rainbow_DTC* dtc, int s, uint32_t end) {
+	const int numSlots = c->partitions[s];
+	const int pos = c->fdlPos[s] = (c->fdlPos[s] + 1) % numSlots;
+	c->blockEnd[s] = end;
+	c->done[s] = 0;
+	
+	bool any = false;
+	for (int lag = 0; lag < numSlots; ++lag) {
+		int8_t& b = c->slotBank[s][(pos - lag + numSlots) % numSlots];
+		if (b >= 0 && (lag == 0 || lag >= chainPartitions(dtc->banks[b].chainTaps, s))) {
+			--dtc->chainRefs[b];
+			b = -1;
+		}
+		any |= b >= 0;
+	}
+	if (chainPartitions(dtc->banks[dtc->frontBank].chainTaps, s) > 0) {
+		c->slotBank[s][pos] = dtc->frontBank;
+		++dtc->chainRefs[dtc->frontBank];
+		any = true;
+	}
+	return any;
+}
+
+// Work unit: transform the block that ended into the channel's new slot
+template <int kN>
+static void chainTransformInput(const FftTables<kN>* t, ChainEngine* c, ChainChannel* cc, int s) {
+	float* slot = cc->fdl[s] + c->fdlPos[s] * (kN + 1) * 2;
+	const uint32_t first = c->blockEnd[s] - 2 * kN;
+	for (int i = 0; i < 2 * kN; ++i) {
+		slot[i] = cc->input[(first + i) & c->ringMask];
+	}
+	fftRealInPlace(t, slot);
+}
+
+// Work unit: accumulate the channel's slots against their banks'
+// partitions and add the result into the output ring
+template <int kN>
+static void chainConvolve(const FftTables<kN>* t, ChainEngine* c, ChainChannel* channels, int ch,
+                          const _rainbow_DTC* dtc, int s) {
+	constexpr int kBins2 = (kN + 1) * 2;
+	ChainChannel* cc = &channels[ch];
+	const int numSlots = c->partitions[s];
+	bool any = false;
+	for (int lag = 0; lag < numSlots; ++lag) {
+		const int slot = (c->fdlPos[s] - lag + numSlots) % numSlots;
+		const int b = c->slotBank[s][slot];
+		if (b < 0 || lag >= chainPartitions(dtc->banks[b].chainTaps, s))
+			continue;
+		const float* __restrict x = cc->fdl[s] + slot * kBins2;
+		const float* __restrict h = channels[dtc->banks[b].shared ? 0 : ch].spectra[s][b] + lag * kBins2;
+		float* __restrict acc = c->acc;
+		int k = 0;
+#ifdef RAINBOW_SIMD
+		for (; k + 4 <= kBins2; k += 4) {
+			Vec4 hr, hi;
+			v4complexSplit(v4load(h + k), hr, hi);
+			const Vec4 y = v4complexMul(v4load(x + k), hr, hi);
+			v4store(acc + k, any ? v4add(v4load(acc + k), y) : y);
+		}
+#endif
+		if (!any) {
+			for (; k < kBins2; k += 2) {
+				acc[k] = x[k] * h[k] - x[k + 1] * h[k + 1];
+				acc[k + 1] = x[k] * h[k + 1] + x[k + 1] * h[k];
+			}
+		} else {
+			for (; k < kBins2; k += 2) {
+				acc[k] += x[k] * h[k] - x[k + 1] * h[k + 1];
+				acc[k + 1] += x[k] * h[k + 1] + x[k + 1] * h[k];
+			}
+		}
+		any = true;
+	}
+	if (!any)
+		return;
+	
+	// Overlap-save: the second half of the circular result is valid
+	ifftReal(t, c->acc, c->y);
+	const uint32_t first = c->blockEnd[s] + kN;
+	for (int i = 0; i < kN; ++i) {
+		cc->output[(first + i) & c->ringMask] += c->y[kN + i];
+	}
+	if ((int32_t)(first + kN - c->written) > 0) c->written = first + kN;
+}
+
+// Run a stage's work units up to its share for this FFT block: two per
+// channel (transform, convolve), idle channels skipped
+template <int kN>
+static void chainRunStage(const FftTables<kN>* t, ChainEngine* c, ChainChannel* channels,
+                          const FftChannel* fftChannels, const _rainbow_DTC* dtc, int numChannels, int s) {
+	constexpr int kSlices = kN / kFftBlockSize;
+	const int units = 2 * numChannels;
+	const int slice = (c->clock / kFftBlockSize) & (kSlices - 1);
+	const int target = (units * (slice + 1) + kSlices - 1) / kSlices;
+	for (; c->done[s] < target; ++c->done[s]) {
+		const int ch = c->done[s] >> 1;
+		if (fftChannels[ch].idle)
+			continue;
+		if (c->done[s] & 1) {
+			chainConvolve(t, c, channels, ch, dtc, s);
+		} else if (c->slotBank[s][c->fdlPos[s]] >= 0) {
+			chainTransformInput(t, c, &channels[ch], s);
+		}
+	}
+}
+
+// At an FFT block boundary, after fftProcessBlock(): feed the block it
+// took to the tail, advance the stages and add the tail's share of the
+// next output block (output time latency behind the input) to each
+// channel's output blocks
+static void chainProcessBlock(ChainEngine* c, ChainChannel* channels, FftChannel* fftChannels,
+                              _rainbow_DTC* dtc, int numChannels, int latency) {
+	const uint32_t mask = c->ringMask;
+	for (int ch = 0; ch < numChannels; ++ch) {
+		float* ring = channels[ch].input;
+		for (int i = 0; i < kFftBlockSize; ++i) {
+			ring[(c->clock + i) & mask] = fftChannels[ch].input[i];
+		}
+	}
+	c->clock += kFftBlockSize;
+	
+	for (int s = 0; s < kNumChainStages; ++s) {
+		if (c->partitions[s] == 0)
+			continue;
+		if ((c->clock & (kChainBlock[s] - 1)) == 0 && !chainEndBlock(c, dtc, s, c->clock)) {
+			c->done[s] = 2 * numChannels;
+		}
+		if (s == 0) {
+			chainRunStage(&c->tables0, c, channels, fftChannels, dtc, numChannels, s);
+		} else {
+			chainRunStage(&c->tables1, c, channels, fftChannels, dtc, numChannels, s);
+		}
+	}
+	
+	// A latency change skips (or repeats) a block of output time; skipped
+	// samples are cleared so that the ring wraps clean
+	const uint32_t from = c->clock - latency;
+	for (; (int32_t)(from - c->readPos) > 0; c->readPos += kFftBlockSize) {
+		for (int ch = 0; ch < numChannels; ++ch) {
+			for (int i = 0; i < kFftBlockSize; ++i) channels[ch].output[(c->readPos + i) & mask] = 0.0f;
+		}
+	}
+	c->readPos = from + kFftBlockSize;
+	if ((int32_t)(c->written - from) <= 0)
+		return;
+	for (int ch = 0; ch < numChannels; ++ch) {
+		FftChannel* fc = &fftChannels[ch];
+		float* ring = channels[ch].output;
+		for (int i = 0; i < kFftBlockSize; ++i) {
+			float& v = ring[(from + i) & mask];
+			fc->output[i] += v;
+			if (fc->newValid) fc->outputNew[i] += v;
+			v = 0.0f;
+		}
+	}
+}
+
+// ============================================================================
+// HELPER FUNCTIONS
+// ============================================================================
+
+// Saturation curves at driven input u (before normalisation)
+static float saturationCurve(int curve, float u) {
+	switch (curve) {
+	case kCurveCubic:
+		u = std::max(-1.0f, std::min(u, 1.0f));
+		return u - u * u * u * (1.0f / 3.0f);
+	case kCurveAsymmetric:
+		return tanhf(u + kAsymmetricBias) - tanhf(kAsymmetricBias);
+	default:
+		return tanhf(u);
+	}
+}
+
+// Sample a curve at the drive for a Saturation amount (1x to 5x),
+// normalised so that full-scale input stays at full scale
+static void buildSaturationTable(SaturationTable* t, int curve, float amount) {
+	const float drive = 1.0f + amount * 4.0f;
+	const float norm = 1.0f / saturationCurve(curve, drive);
+	constexpr float kStep = 2.0f * kSaturationRange / kSaturationTableSize;
+	for (int i = 0; i <= kSaturationTableSize; ++i) {
+		t->values[i] = saturationCurve(curve, (i - kSaturationTableSize / 2) * kStep) * norm;
+	}
+	t->scale = drive / kStep;
+}
+
+RAINBOW_HOT_INLINE static inline float softSaturate(const SaturationTable* __restrict t, float x) {
+	float pos = x * t->scale + kSaturationTableSize / 2;
+	pos = std::max(0.0f, std::min(pos, (float)kSaturationTableSize));
+	const int i = std::min((int)pos, kSaturationTableSize - 1);
+	const float frac = pos - i;
+	return t->values[i] + frac * (t->values[i + 1] - t->values[i]);
+}
+
+#ifdef RAINBOW_SIMD
+static inline Vec4 v4softSaturate(const SaturationTable* __restrict t, Vec4 x) {
+	const Vec4 pos = v4fma(x, v4splat(t->scale), v4splat(kSaturationTableSize / 2));
+	return v4lerpTable(t->values, v4max(v4zero(), v4min(pos, v4splat((float)kSaturationTableSize))),
+	                   kSaturationTableSize - 1);
+}
+#endif
+
+// Direct-form FIR producing four consecutive outputs per pass over the taps.
+// x points at the newest of the four samples in the mirrored delay line.
+// Coefficients and a seven-sample window of the delay line stay in registers,
+// so each tap is loaded once per four outputs instead of once per output.
+// Every output keeps its own four-phase accumulators, summed in the same
+// order as a single-output loop, so results are bit-identical to it.
+// With host SIMD each phase is one vector across the four outputs.
+RAINBOW_HOT_INLINE static inline void firBlock4(const float* __restrict x, const float* __restrict h,
+                                                int kernelSize, float* __restrict y) {
+#ifdef RAINBOW_SIMD
+	Vec4 a0 = v4zero(), a1 = v4zero(), a2 = v4zero(), a3 = v4zero();
+	for (int k = 0; k < kernelSize; k += 4) {
+		const Vec4 hk = v4load(h + k);
+		a0 = v4fmaLane<0>(v4load(x - 3 - k), hk, a0);
+		a1 = v4fmaLane<1>(v4load(x - 4 - k), hk, a1);
+		a2 = v4fmaLane<2>(v4load(x - 5 - k), hk, a2);
+		a3 = v4fmaLane<3>(v4load(x - 6 - k), hk, a3);
+	}
+	v4store(y, v4add(v4add(a0, a1), v4add(a2, a3)));
+#else
+	float a00 = 0.0f, a01 = 0.0f, a02 = 0.0f, a03 = 0.0f;
+	float a10 = 0.0f, a11 = 0.0f, a12 = 0.0f, a13 = 0.0f;
+	float a20 = 0.0f, a21 = 0.0f, a22 = 0.0f, a23 = 0.0f;
+	float a30 = 0.0f, a31 = 0.0f, a32 = 0.0f, a33 = 0.0f;
+	
+	float w0 = x[0], w1 = x[-1], w2 = x[-2];
+	for (int k = 0; k < kernelSize; k += 4) {
+		const float h0 = h[k], h1 = h[k + 1], h2 = h[k + 2], h3 = h[k + 3];
+		const float w3 = x[-3], w4 = x[-4], w5 = x[-5], w6 = x[-6];
+		
+		a00 = fmaf(w3, h0, a00); a01 = fmaf(w4, h1, a01); a02 = fmaf(w5, h2, a02); a03 = fmaf(w6, h3, a03);
+		a10 = fmaf(w2, h0, a10); a11 = fmaf(w3, h1, a11); a12 = fmaf(w4, h2, a12); a13 = fmaf(w5, h3, a13);
+		a20 = fmaf(w1, h0, a20); a21 = fmaf(w2, h1, a21); a22 = fmaf(w3, h2, a22); a23 = fmaf(w4, h3, a23);
+		a30 = fmaf(w0, h0, a30); a31 = fmaf(w1, h1, a31); a32 = fmaf(w2, h2, a32); a33 = fmaf(w3, h3, a33);
+		
+		w0 = w4; w1 = w5; w2 = w6;
+		x -= 4;
+	}
+	
+	y[0] = (a00 + a01) + (a02 + a03);
+	y[1] = (a10 + a11) + (a12 + a13);
+	y[2] = (a20 + a21) + (a22 + a23);
+	y[3] = (a30 + a31) + (a32 + a33);
+#endif
+}
+
+// firBlock4 for a kernel mirrored over [first, taps): the two delay-line
+// samples of each tap pair are added (kOdd: subtracted) before a single
+// multiply. Near and far windows slide in opposite directions, one new
+// load each per pair; the near window ends on the centre tap.
+template <bool kOdd>
+RAINBOW_HOT_INLINE static inline void firBlock4Folded(const float* __restrict x, const float* __restrict h,
+                                                      int first, int taps, float* __restrict y) {
+	const int half = (taps - first) >> 1;
+	const float* near = x - 3 - first;      // delay first + k for output j at near[j - k]
+	const float* far = x - 3 - (taps - 1);  // delay taps - 1 - k at far[j + k]
+#ifdef RAINBOW_SIMD
+	Vec4 a = v4zero();
+	for (int k = 0; k < half; ++k) {
+		const Vec4 n = v4load(near - k), f = v4load(far + k);
+		a = v4fma(kOdd ? v4sub(n, f) : v4add(n, f), v4splat(h[first + k]), a);
+	}
+	if (!kOdd && ((taps - first) & 1)) a = v4fma(v4load(near - half), v4splat(h[first + half]), a);
+	if (first) a = v4fma(v4load(x - 3), v4splat(h[0]), a);
+	v4store(y, a);
+#else
+	float a0 = 0.0f, a1 = 0.0f, a2 = 0.0f, a3 = 0.0f;
+	float n0 = near[0], n1 = near[1], n2 = near[2], n3 = near[3];
+	float f0 = far[0], f1 = far[1], f2 = far[2], f3 = far[3];
+	for (int k = 0; k < half; ++k) {
+		const float c = h[first + k];
+		a0 = fmaf(kOdd ? n0 - f0 : n0 + f0, c, a0);
+		a1 = fmaf(kOdd ? n1 - f1 : n1 + f1, c, a1);
+		a2 = fmaf(kOdd ? n2 - f2 : n2 + f2, c, a2);
+		a3 = fmaf(kOdd ? n3 - f3 : n3 + f3, c, a3);
+		
+		n3 = n2; n2 = n1; n1 = n0; n0 = near[-k - 1];
+		f0 = f1; f1 = f2; f2 = f3; f3 = far[k + 4];
+	}
+	
+	// Centre tap of an odd span (zero when antisymmetric)
+	if (!kOdd && ((taps - first) & 1)) {
+		const float c = h[first + half];
+		a0 = fmaf(n0, c, a0); a1 = fmaf(n1, c, a1); a2 = fmaf(n2, c, a2); a3 = fmaf(n3, c, a3);
+	}
+	if (first) {
+		const float c = h[0];
+		a0 = fmaf(x[-3], c, a0); a1 = fmaf(x[-2], c, a1); a2 = fmaf(x[-1], c, a2); a3 = fmaf(x[0], c, a3);
+	}
+	
+	y[0] = a0;
+	y[1] = a1;
+	y[2] = a2;
+	y[3] = a3;
+#endif
+}
+
+// firBlock4 of the even taps h[0], h[2], ... (count of them) at the odd
+// delays 1, 3, ... of the half-band line (see makeHalfRate), which u
+// points into at the newest of the four outputs. Consecutive taps share
+// two of the four line samples, so each tap takes two new loads.
+RAINBOW_HOT_INLINE static inline void firBlock4HalfRate(const float* __restrict u, const float* __restrict h,
+                                                        int count, float* __restrict y) {
+#ifdef RAINBOW_SIMD
+	Vec4 a = v4zero();
+	for (int m = 0; m < count; ++m) {
+		a = v4fma(v4load(u - 4 - 2 * m), v4splat(h[2 * m]), a);
+	}
+	v4store(y, a);
+#else
+	float a0 = 0.0f, a1 = 0.0f, a2 = 0.0f, a3 = 0.0f;
+	
+	float s0 = u[-1], s1 = u[-2], s2 = u[-3], s3 = u[-4];
+	for (int m = 0; m < count; ++m) {
+		const float c = h[2 * m];
+		a3 = fmaf(s0, c, a3); a2 = fmaf(s1, c, a2); a1 = fmaf(s2, c, a1); a0 = fmaf(s3, c, a0);
+		s0 = s2; s1 = s3; s2 = u[-5 - 2 * m]; s3 = u[-6 - 2 * m];
+	}
+	
+	y[0] = a0;
+	y[1] = a1;
+	y[2] = a2;
+	y[3] = a3;
+#endif
+}
+
+// Half-band line sample for the newest input at x: the input interpolated
+// as makeHalfRate() interpolates odd taps, three samples late
+RAINBOW_HOT_INLINE static inline float halfBandSample(const float* x) {
+	return x[-3] + 0.5625f * (x[-2] + x[-4]) - 0.0625f * (x[0] + x[-6]);
+}
+
+// acc + a.lo * b.hi + a.hi * b.lo over packed Q15 pairs (SMLALDX)
+RAINBOW_HOT_INLINE static inline int64_t smlaldx(uint32_t a, uint32_t b, int64_t acc) {
+#if defined(__ARM_FEATURE_DSP)
+	return __smlaldx((int32_t)a, (int32_t)b, acc);
+#else
+	return acc + (int32_t)(int16_t)a * (int16_t)(b >> 16) + (int32_t)(int16_t)(a >> 16) * (int16_t)b;
+#endif
+}
+
+RAINBOW_HOT_INLINE static inline uint32_t loadPair(const int16_t* p) {
+	uint32_t pair;
+	memcpy(&pair, p, sizeof(pair));  // unaligned word load on the M7
+	return pair;
+}
+
+// Fixed-point firBlock4: Q15 delay line and kernel, two taps per
+// instruction. Each pair of delay-line samples is loaded once per pass
+// and serves two outputs, as in firBlock4.
+RAINBOW_HOT_INLINE static inline void firBlock4Q15(const int16_t* __restrict x, const int16_t* __restrict h,
+                                                   int kernelSize, float scale, float* __restrict y) {
+	int64_t a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+	
+	uint32_t p0 = loadPair(x - 1), p1 = loadPair(x - 2);
+	for (int k = 0; k < kernelSize; k += 2) {
+		const uint32_t hp = loadPair(h + k);
+		const uint32_t p2 = loadPair(x - 3 - k), p3 = loadPair(x - 4 - k);
+		a3 = smlaldx(hp, p0, a3);
+		a2 = smlaldx(hp, p1, a2);
+		a1 = smlaldx(hp, p2, a1);
+		a0 = smlaldx(hp, p3, a0);
+		p0 = p2; p1 = p3;
+	}
+	
+	y[0] = (float)(int32_t)(a0 >> kFixedAccShift) * scale;
+	y[1] = (float)(int32_t)(a1 >> kFixedAccShift) * scale;
+	y[2] = (float)(int32_t)(a2 >> kFixedAccShift) * scale;
+	y[3] = (float)(int32_t)(a3 >> kFixedAccShift) * scale;
+}
+
+static inline int16_t toQ15(float x) {
+	return (int16_t)std::max(-32768, std::min((int)lrintf(x), 32767));
+}
+
+// Bus voltage to the fixed-point input format (rounded, clipped at full scale)
+RAINBOW_HOT_INLINE static inline int16_t sampleToQ15(float x) {
+	x = std::max(-32768.0f, std::min(x * (float)(1 << kFixedInputBits), 32767.0f));
+	return (int16_t)(int32_t)(x + (x >= 0.0f ? 0.5f : -0.5f));
+}
+
+// Power-of-two scale putting a kernel's peak in the top octave of Q15
+static int q15Shift(const float* kernel, int taps) {
+	float peak = 0.0f;
+	for (int i = 0; i < taps; ++i) {
+		peak = std::max(peak, fabsf(kernel[i]));
+	}
+	int exponent;
+	frexpf(peak, &exponent);
+	return 15 - exponent;
+}
+
+// Dry/wet mix, saturation (curve is NULL when off) and output gain for one sample
+static inline float mixSample(float dry, float wet, float dryMix, float depth,
+                              const SaturationTable* curve, float gain) {
+	float mixed = fmaf(dry, dryMix, wet * depth);
+	if (curve) mixed = softSaturate(curve, mixed);
+	return mixed * gain;
+}
+
+// Output of an idle channel: the dry path alone
+static inline void mixIdle(const float* __restrict in, float* __restrict out, int numFrames, bool replace,
+                           float dryMix, const SaturationTable* curve, float gain) {
+	for (int i = 0; i < numFrames; ++i) {
+		const float mixed = mixSample(in[i], 0.0f, dryMix, 0.0f, curve, gain);
+		if (replace) out[i] = mixed;
+		else out[i] += mixed;
+	}
+}
+
+// In-place complex FFT of any power-of-two size, for kernel preparation
+// outside the audio path (the engine above uses fixed tables). Twiddles
+// come from a double-precision recurrence seeded with sinf() (the FPU
+// runs doubles, but there is no double libm); the inverse is unscaled.
+static void fftComplexAnySize(float* data, int n, bool inverse) {
+	for (int i = 1, j = 0; i < n; ++i) {
+		int bit = n >> 1;
+		for (; j & bit; bit >>= 1) j ^= bit;
+		j |= bit;
+		if (i < j) {
+			std::swap(data[2 * i], data[2 * j]);
+			std::swap(data[2 * i + 1], data[2 * j + 1]);
+		}
+	}
+	
+	constexpr float kPi = 3.14159265358979f;
+	for (int len = 2; len <= n; len <<= 1) {
+		const float theta = (inverse ? 2.0f : -2.0f) * kPi / len;
+		const double halfSin = sinf(0.5f * theta);
+		const double wpr = -2.0 * halfSin * halfSin;
+		const double wpi = sinf(theta);
+		double wr = 1.0, wi = 0.0;
+		for (int k = 0; k < len / 2; ++k) {
+			for (int i = k; i < n; i += len) {
+				float* a = &data[2 * i];
+				float* b = &data[2 * (i + len / 2)];
+				const float tr = (float)wr * b[0] - (float)wi * b[1];
+				const float ti = (float)wr * b[1] + (float)wi * b[0];
+				b[0] = a[0] - tr; b[1] = a[1] - ti;
+				a[0] += tr; a[1] += ti;
+			}
+			const double t = wr;
+			wr += wr * wpr - wi * wpi;
+			wi += wi * wpr + t * wpi;
+		}
+	}
+}
+
+// Replace a kernel with the minimum-phase kernel of the same magnitude
+// response (homomorphic method: fold the real cepstrum onto positive
+// quefrencies), then restore its L1 norm. Energy moves to the
+// start of the kernel, so Energy truncation keeps fewer taps.
+// work holds kernelSize * kMinPhaseOversample complex values.
+static void makeMinimumPhase(float* kernel, int kernelSize, float* work) {
+	const int n = kernelSize * kMinPhaseOversample;
+	const float invN = 1.0f / n;
+	
+	float norm = 0.0f;
+	for (int i = 0; i < n; ++i) {
+		work[2 * i] = i < kernelSize ? kernel[i] : 0.0f;
+		work[2 * i + 1] = 0.0f;
+		if (i < kernelSize) norm += fabsf(kernel[i]);
+	}
+	fftComplexAnySize(work, n, false);
+	
+	// Log magnitude, floored 100dB below the peak
+	float peak = 0.0f;
+	for (int i = 0; i < n; ++i) {
+		peak = std::max(peak, work[2 * i] * work[2 * i] + work[2 * i + 1] * work[2 * i + 1]);
+	}
+	if (peak <= 0.0f)
+		return;
+	const float floorPower = peak * 1e-10f;
+	for (int i = 0; i < n; ++i) {
+		const float power = work[2 * i] * work[2 * i] + work[2 * i + 1] * work[2 * i + 1];
+		work[2 * i] = 0.5f * logf(std::max(power, floorPower));
+		work[2 * i + 1] = 0.0f;
+	}
+	
+	// Real cepstrum, folded to be causal
+	fftComplexAnySize(work, n, true);
+	for (int i = 0; i < n; ++i) {
+		float c = work[2 * i] * invN;
+		if (i > 0 && i < n / 2) c *= 2.0f;
+		else if (i > n / 2) c = 0.0f;
+		work[2 * i] = c;
+		work[2 * i + 1] = 0.0f;
+	}
+	
+	// Back to a spectrum, exponentiate, and back to a kernel
+	fftComplexAnySize(work, n, false);
+	for (int i = 0; i < n; ++i) {
+		const float mag = expf(work[2 * i]);
+		const float phase = work[2 * i + 1];
+		work[2 * i] = mag * cosf(phase);
+		work[2 * i + 1] = mag * sinf(phase);
+	}
+	fftComplexAnySize(work, n, true);
+	
+	float sum = 0.0f;
+	for (int i = 0; i < kernelSize; ++i) {
+		kernel[i] = work[2 * i] * invN;
+		sum += fabsf(kernel[i]);
+	}
+	if (sum > 0.001f) {
+		const float scale = norm / sum;
+		for (int i = 0; i < kernelSize; ++i) {
+			kernel[i] *= scale;
+		}
+	}
+}
+
+// L1-normalise the first taps of a kernel whose abs sum is sum, as
+// buildKernelAtIndex() always has (kernels too quiet to scale are left)
+static inline void normaliseKernel(float* kernel, int taps, float sum) {
+	if (sum > 0.001f) {
+		const float scale = 1.0f / sum;
+		for (int i = 0; i < taps; ++i) {
+			kernel[i] *= scale;
+		}
+	}
+}
+
+static inline const WaveSlot* frontWaves(_rainbowAlgorithm* pThis) {
+	return pThis->frontSlot.load(std::memory_order_acquire);
+}
+
+static inline int loadedWaves(_rainbowAlgorithm* pThis) {
+	return frontWaves(pThis)->numWaves;
+}
+
+static inline const int16_t* waveMip(_rainbowAlgorithm* pThis, int kernelSize, int wave) {
+	return frontWaves(pThis)->levels + kMaxWaves * (kernelSize - kKernelSizes[0]) + kernelSize * wave;
+}
+
+// Shortest prefix of a kernel holding the Energy fraction of its L2
+// energy, rounded up to the four-tap step of firBlock4
+static int effectiveTaps(const float* kernel, int kernelSize, float fraction) {
+	if (fraction >= 1.0f)
+		return kernelSize;
+	
+	float total = 0.0f;
+	for (int i = 0; i < kernelSize; ++i) {
+		total += kernel[i] * kernel[i];
+	}
+	const float target = total * fraction;
+	float sum = 0.0f;
+	int taps = 0;
+	while (taps < kernelSize && sum < target) {
+		sum += kernel[taps] * kernel[taps];
+		++taps;
+	}
+	return std::max(4, (taps + 3) & ~3);
+}
+
+// Convert one wave into its cache row, unnormalised, and record its L1
+// sum (the kernel job's cache stage, one row per item)
+static void buildCacheRow(_rainbowAlgorithm* pThis, int w, int kernelSize) {
+	const int16_t* mip = waveMip(pThis, kernelSize, w);
+	float* row = pThis->kernelCache + w * kernelSize;
+	for (int i = 0; i < kernelSize; ++i) {
+		row[i] = mip[i] / 32768.0f;
+	}
+	if (pThis->v[kParamPhase]) {
+		makeMinimumPhase(row, kernelSize, pThis->phaseWork);
+	}
+	float sum = 0.0f;
+	for (int i = 0; i < kernelSize; ++i) {
+		sum += fabsf(row[i]);
+	}
+	pThis->cacheSums[w] = sum;
+	pThis->cacheTaps[w] = effectiveTaps(row, kernelSize, pThis->v[kParamEnergy] * 0.001f);
+}
+
+// Magnitude response of a kernel in display rows, one per log-spaced
+// column (the kernel job's response stage, in the minimum-phase scratch)
+static void measureResponse(_rainbowAlgorithm* pThis, const float* kernel, int taps, int kernelSize, float* rows) {
+	const int n = kernelSize * kMinPhaseOversample;
+	float* work = pThis->phaseWork;
+	for (int i = 0; i < n; ++i) {
+		work[2 * i] = i < taps ? kernel[i] : 0.0f;
+		work[2 * i + 1] = 0.0f;
+	}
+	fftComplexAnySize(work, n, false);
+	
+	const float nyquist = 0.5f * NT_globals.sampleRate;
+	const float octaves = log2f(nyquist / kResponseLowHz);
+	float peak = -1000.0f;
+	for (int c = 0; c < kDisplaySize; ++c) {
+		const float hz = kResponseLowHz * exp2f(octaves * c / (kDisplaySize - 1));
+		const int bin = std::min((int)(hz / nyquist * (n / 2) + 0.5f), n / 2);
+		const float power = work[2 * bin] * work[2 * bin] + work[2 * bin + 1] * work[2 * bin + 1];
+		rows[c] = 10.0f * log10f(std::max(power, 1e-20f));
+		peak = std::max(peak, rows[c]);
+	}
+	for (int c = 0; c < kDisplaySize; ++c) {
+		rows[c] = std::min((peak - rows[c]) * (1.0f / kResponseRangeDb), 1.0f);
+	}
+}
+
+// Blend two waves of the active mip level into a kernel, then
+// L1-normalise the blend: at full Energy and original phase, bit for bit
+// the kernel the cache-less engine built. Energy truncates the normalised
+// blend at the longer of the two waves' lengths. Returns the effective
+// length; taps beyond it are cleared.
+static int buildKernel(_rainbowAlgorithm* pThis, float* dest, int kernelSize, int wave0, int wave1, float frac) {
+	if (pThis->cacheKernelSize.load(std::memory_order_acquire) == kernelSize
+	    && std::max(wave0, wave1) < pThis->cacheNumWaves) {
+		const float* __restrict row0 = pThis->kernelCache + wave0 * kernelSize;
+		const float* __restrict row1 = pThis->kernelCache + wave1 * kernelSize;
+		int taps;
+		float sum;
+		if (frac == 0.0f) {
+			// One wave: its sum is cached, and only its own taps are needed
+			taps = pThis->cacheTaps[wave0];
+			sum = pThis->cacheSums[wave0];
+			for (int i = 0; i < taps; ++i) {
+				dest[i] = row0[i];
+			}
+		} else {
+			taps = std::max(pThis->cacheTaps[wave0], pThis->cacheTaps[wave1]);
+			sum = 0.0f;
+			for (int i = 0; i < kernelSize; ++i) {
+				dest[i] = row0[i] + frac * (row1[i] - row0[i]);
+				sum += fabsf(dest[i]);
+			}
+		}
+		normaliseKernel(dest, taps, sum);
+		for (int i = taps; i < kernelSize; ++i) {
+			dest[i] = 0.0f;
+		}
+		return taps;
+	}
+	
+	// Cache miss (being rebuilt)
+	const int16_t* mip0 = waveMip(pThis, kernelSize, wave0);
+	const int16_t* mip1 = waveMip(pThis, kernelSize, wave1);
+	float sum = 0.0f;
+	for (int i = 0; i < kernelSize; ++i) {
+		float v0 = mip0[i] / 32768.0f;
+		float v1 = mip1[i] / 32768.0f;
+		dest[i] = v0 + frac * (v1 - v0);
+		sum += fabsf(dest[i]);
+	}
+	normaliseKernel(dest, kernelSize, sum);
+	return kernelSize;
+}
+
+// Clamped wave position for an Index value
+static inline float waveOffset(int numWaves, float indexParam) {
+	indexParam = std::max(0.0f, std::min(1.0f, indexParam));
+	float offset = indexParam * (numWaves - 1);
+	return std::max(0.0f, std::min(offset, (float)(numWaves - 1) - 0.0001f));
+}
+
+static int buildKernelAtIndex(_rainbowAlgorithm* pThis, float* dest, int kernelSize, float indexParam) {
+	const int numWaves = loadedWaves(pThis);
+	float offset = waveOffset(numWaves, indexParam);
+	
+	int wave0 = (int)offset;
+	int wave1 = std::min(wave0 + 1, numWaves - 1);
+	float frac = offset - wave0;
+	
+	return buildKernel(pThis, dest, kernelSize, wave0, wave1, frac);
+}
+
+// Taps [first, first + count) of a chain kernel, times scale: the waves
+// from the one at the wave position on, end to end at kMaxKernelSize
+// (wrapping around the table), each blended with the wave after it and
+// normalised as a single kernel would be. Chains are scaled down by the
+// square root of their length in waves, which keeps their level near a
+// single wave's.
+static void buildChainTaps(_rainbowAlgorithm* pThis, float* dest, float indexParam, int chainTaps,
+                           int first, int count, float scale) {
+	constexpr int n = kMaxKernelSize;
+	const int numWaves = loadedWaves(pThis);
+	const float offset = waveOffset(numWaves, indexParam);
+	const int wave0 = (int)offset;
+	const int wave1 = std::min(wave0 + 1, numWaves - 1);
+	const float frac = offset - wave0;
+	const float gain = scale / sqrtf((float)(chainTaps / n));
+	const bool cached = pThis->cacheKernelSize.load(std::memory_order_acquire) == n
+	                 && numWaves <= pThis->cacheNumWaves;
+	
+	for (int i = 0; i < count; ) {
+		const int segment = (first + i) / n;
+		const int k = (first + i) % n;
+		const int run = std::min(count - i, n - k);
+		const int w0 = (wave0 + segment) % numWaves;
+		const int w1 = (wave1 + segment) % numWaves;
+		// The segment's blend is summed whole, however little of it is
+		// wanted
+		float sum = 0.0f;
+		if (cached) {
+			const float* __restrict row0 = pThis->kernelCache + w0 * n;
+			const float* __restrict row1 = pThis->kernelCache + w1 * n;
+			for (int j = 0; j < n; ++j) {
+				sum += fabsf(row0[j] + frac * (row1[j] - row0[j]));
+			}
+			const float segmentGain = sum > 0.001f ? gain / sum : gain;
+			for (int j = 0; j < run; ++j) {
+				dest[i + j] = (row0[k + j] + frac * (row1[k + j] - row0[k + j])) * segmentGain;
+			}
+		} else {
+			const int16_t* mip0 = waveMip(pThis, n, w0);
+			const int16_t* mip1 = waveMip(pThis, n, w1);
+			for (int j = 0; j < n; ++j) {
+				const float v0 = mip0[j] / 32768.0f;
+				const float v1 = mip1[j] / 32768.0f;
+				sum += fabsf(v0 + frac * (v1 - v0));
+			}
+			const float segmentGain = sum > 0.001f ? gain / sum : gain;
+			for (int j = 0; j < run; ++j) {
+				const float v0 = mip0[k + j] / 32768.0f;
+				const float v1 = mip1[k + j] / 32768.0f;
+				dest[i + j] = (v0 + frac * (v1 - v0)) * segmentGain;
+			}
+		}
+		i += run;
+	}
+}
+
+// Direct-form engine in use: Engine, within Max Engine
+static inline int directEngine(_rainbowAlgorithm* pThis) {
+	return std::min((int)pThis->v[kParamEngine], pThis->maxEngine);
+}
+
+// Whether new kernels may take the half-rate form (which approximates them)
+static inline bool allowHalfRate(_rainbowAlgorithm* pThis) {
+	return directEngine(pThis) == kDirectHalfRate;
+}
+
+// Key of the kernel buildKernelAtIndex() (or for a chain, buildChainTaps())
+// would build now. Chains keep every wave whole.
+static KernelKey kernelKeyAtIndex(_rainbowAlgorithm* pThis, int kernelSize, int chainTaps, float indexParam) {
+	const int numWaves = loadedWaves(pThis);
+	const float offset = waveOffset(numWaves, indexParam);
+	const int wave0 = (int)offset;
+	const int wave1 = std::min(wave0 + 1, numWaves - 1);
+	
+	KernelKey key = { offset, 0, 0, (uint16_t)kernelSize, (uint16_t)chainTaps, allowHalfRate(pThis), 0 };
+	if (pThis->cacheKernelSize.load(std::memory_order_acquire) == kernelSize && wave1 < pThis->cacheNumWaves) {
+		key.taps0 = chainTaps ? kernelSize : pThis->cacheTaps[wave0];
+		key.taps1 = chainTaps ? kernelSize : pThis->cacheTaps[wave1];
+		key.cacheStamp = pThis->cacheStamp;
+	}
+	return key;
+}
+
+static inline bool sameKernel(const KernelKey& a, const KernelKey& b) {
+	return a.cacheStamp != 0 && a.cacheStamp == b.cacheStamp && a.offset == b.offset
+	    && a.taps0 == b.taps0 && a.taps1 == b.taps1 && a.kernelSize == b.kernelSize
+	    && a.chainTaps == b.chainTaps && a.halfRate == b.halfRate;
+}
+
+static inline bool isSharedKernel(_rainbowAlgorithm* pThis) {
+	return pThis->v[kParamSpread] * 0.001f < 0.001f || pThis->numChannels == 1;
+}
+
+// Chain length new sets are built with (none in morph mode)
+static inline int chainLength(_rainbowAlgorithm* pThis) {
+	if (pThis->dtc->morph)
+		return 0;
+	return kChainSizes[std::min((int)pThis->v[kParamChain], pThis->maxChainIndex)];
+}
+
+// Wave position of a channel (unclamped), including its Spread offset
+static inline float channelIndex(_rainbowAlgorithm* pThis, int ch) {
+	float indexParam = pThis->v[kParamIndex] * 0.001f;
+	if (isSharedKernel(pThis))
+		return indexParam;
+	float spread = pThis->v[kParamSpread] * 0.001f;
+	float chOffset = spread * ((float)ch / (pThis->numChannels - 1) - 0.5f);
+	return indexParam + chOffset;
+}
+
+static inline bool useFftEngine(int kernelSize) {
+	return kernelSize >= kMinFftKernelSize;
+}
+
+// FFT partitions reached by a bank's effective length
+static inline int bankPartitions(const KernelBank* bank) {
+	return (bank->numTaps + kFftBlockSize - 1) / kFftBlockSize;
+}
+
+// Partitions a bank leaves to the direct-form head in the FFT engine:
+// one at zero latency, and always one for a kernel of a direct-form size
+// (crossfading across a size change), which plays without latency
+static inline int bankHead(const FftEngine* e, const KernelBank* bank) {
+	return useFftEngine(bank->kernelSize) ? e->headPartitions : 1;
+}
+
+// Mirror test of kernel[first, taps) against the kernel's peak. A centre
+// tap has no partner, but must be zero for antisymmetry.
+static bool isMirrored(const float* kernel, int first, int taps, bool odd, float tolerance) {
+	const int span = taps - first;
+	for (int k = 0; k < span / 2; ++k) {
+		const float a = kernel[first + k];
+		const float b = kernel[taps - 1 - k];
+		if (fabsf(odd ? a + b : a - b) > tolerance)
+			return false;
+	}
+	return !odd || !(span & 1) || fabsf(kernel[first + span / 2]) <= tolerance;
+}
+
+// Classify a kernel for folding, trying the whole length and then all but
+// a lone leading tap (a wave starting on a zero crossing, such as a sine,
+// mirrors about taps / 2). A match is made exact, so the folded FIR
+// convolves the same kernel as the plain one.
+static int detectSymmetry(float* kernel, int taps, int& first) {
+	float peak = 0.0f;
+	for (int i = 0; i < taps; ++i) {
+		peak = std::max(peak, fabsf(kernel[i]));
+	}
+	const float tolerance = peak * kSymmetryTolerance;
+	
+	for (first = 0; first < 2; ++first) {
+		for (int form = kFormEven; form <= kFormOdd; ++form) {
+			const bool odd = form == kFormOdd;
+			if (!isMirrored(kernel, first, taps, odd, tolerance))
+				continue;
+			const int span = taps - first;
+			for (int k = 0; k < span / 2; ++k) {
+				float& a = kernel[first + k];
+				float& b = kernel[taps - 1 - k];
+				const float m = 0.5f * (odd ? a - b : a + b);
+				a = m;
+				b = odd ? -m : m;
+			}
+			if (odd && (span & 1)) kernel[first + span / 2] = 0.0f;
+			return form;
+		}
+	}
+	first = 0;
+	return kFormPlain;
+}
+
+// Tap k of a kernel if in [lo, hi), else zero
+static inline float tapInRange(const float* kernel, int k, int lo, int hi) {
+	return k >= lo && k < hi ? kernel[k] : 0.0f;
+}
+
+// Half-band interpolation of odd tap k from the even taps in [lo, hi)
+// around it (4-point cubic: 9/16 of the nearest pair less 1/16 of the next)
+static inline float interpolateOddTap(const float* kernel, int k, int lo, int hi) {
+	const float a = tapInRange(kernel, k - 1, lo, hi) + tapInRange(kernel, k + 1, lo, hi);
+	const float b = tapInRange(kernel, k - 3, lo, hi) + tapInRange(kernel, k + 3, lo, hi);
+	return 0.5625f * a - 0.0625f * b;
+}
+
+// Try a kernel in half-rate form: even taps [kHalfRateEndTaps / 2,
+// taps - 2) against the half-band line, plus the exact residual of the
+// first and last kHalfRateEndTaps (which the interpolation nearest the
+// ends cannot reach) at full rate. Qualifies when the interpolated odd
+// taps in between hold the kernel's energy to within kHalfRateTolerance,
+// as when nearly all of it is below fs/4. A match is made exact: the
+// kernel takes the interpolated taps, so the plain FIR and the half-rate
+// one convolve the same filter.
+static bool makeHalfRate(float* kernel, int taps, float* ends) {
+	if (taps < kMinHalfRateTaps)
+		return false;
+	
+	const int lo = kHalfRateEndTaps / 2;  // first even tap on the half-band line
+	const int hi = taps - 2;              // its interpolation ends by taps - 1
+	const int foot = taps - kHalfRateEndTaps;
+	float energy = 0.0f, error = 0.0f;
+	for (int k = 0; k < taps; ++k) {
+		energy += kernel[k] * kernel[k];
+	}
+	for (int k = kHalfRateEndTaps + 1; k < foot; k += 2) {
+		const float e = kernel[k] - interpolateOddTap(kernel, k, 0, taps);
+		error += e * e;
+	}
+	if (error > energy * kHalfRateTolerance)
+		return false;
+	
+	// Residual at the ends: the kernel less what the even taps on the line
+	// contribute there (their own value at even taps, interpolation at odd)
+	for (int i = 0; i < kHalfRateEndTaps; ++i) {
+		for (int half = 0; half < 2; ++half) {
+			const int k = half ? foot + i : i;
+			const float line = (k & 1) ? interpolateOddTap(kernel, k, lo, hi)
+			                 : tapInRange(kernel, k, lo, hi);
+			ends[half * kHalfRateEndTaps + i] = kernel[k] - line;
+		}
+	}
+	for (int k = kHalfRateEndTaps + 1; k < foot; k += 2) {
+		kernel[k] = interpolateOddTap(kernel, k, lo, hi);
+	}
+	return true;
+}
+
+// Refresh what the engine reads from one time-domain kernel: partition
+// spectra (FFT engine), or the shortcut form and the Q15 copy (direct
+// form, Engine = Fixed). Folding is cheaper than half rate, so it wins.
+static void prepareKernel(_rainbowAlgorithm* pThis, int b, int ch) {
+	KernelBank* bank = &pThis->dtc->banks[b];
+	float* kernel = bank->kernels[ch];
+	if (useFftEngine(bank->kernelSize)) {
+		bank->form[ch] = kFormPlain;
+		buildSpectra(pThis->fft, kernel, bank->kernelSize, pThis->fftChannels[ch].spectra[b]);
+		return;
+	}
+	
+	const int taps = bank->taps[ch];
+	int first;
+	bank->form[ch] = detectSymmetry(kernel, taps, first);
+	bank->foldStart[ch] = first;
+	int16_t* q = bank->kernelsQ15[ch];
+	if (q) {
+		const int shift = q15Shift(kernel, taps);
+		for (int i = 0; i < taps; ++i) {
+			q[i] = toQ15(ldexpf(kernel[i], shift));
+		}
+		memset(q + taps, 0, (bank->kernelSize - taps) * sizeof(int16_t));
+		bank->fixedScale[ch] = ldexpf(1.0f, kFixedAccShift - shift - kFixedInputBits);
+	}
+	
+	// After the Q15 copy, which keeps the exact kernel
+	if (bank->form[ch] == kFormPlain && allowHalfRate(pThis) && makeHalfRate(kernel, taps, bank->halfRateEnds[ch])) {
+		bank->form[ch] = kFormHalfRate;
+	}
+}
+
+// Build (and prepare) one slot of a bank for the current Index/Spread at
+// the bank's kernel size; for a chain, its head. A slot that already
+// holds the kernel wanted, from the last set built into this bank, is
+// left as it is (returns false): under Spread, channels pinned at either
+// end of the table and the centre channel often are.
+static bool buildBankSlot(_rainbowAlgorithm* pThis, int b, int ch) {
+	KernelBank* bank = &pThis->dtc->banks[b];
+	const float indexParam = channelIndex(pThis, ch);
+	const KernelKey key = kernelKeyAtIndex(pThis, bank->kernelSize, bank->chainTaps, indexParam);
+	const bool build = !sameKernel(key, bank->keys[ch]);
+	if (build) {
+		if (bank->chainTaps) {
+			buildChainTaps(pThis, bank->kernels[ch], indexParam, bank->chainTaps, 0, bank->kernelSize, 1.0f);
+			bank->taps[ch] = bank->kernelSize;
+		} else {
+			bank->taps[ch] = buildKernelAtIndex(pThis, bank->kernels[ch], bank->kernelSize, indexParam);
+		}
+		prepareKernel(pThis, b, ch);
+		bank->keys[ch] = key;
+	}
+	bank->numTaps = std::max(bank->numTaps, bank->taps[ch]);
+	return build;
+}
+
+// Items a bank's kernel slot takes to build: the kernel (or a chain's
+// head), then each partition of a chain's tail
+static inline int kernelParts(const KernelBank* bank) {
+	return 1 + chainPartitions(bank->chainTaps, 0) + chainPartitions(bank->chainTaps, 1);
+}
+
+template <int kN>
+static void buildChainSpectrum(const FftTables<kN>* t, _rainbowAlgorithm* pThis, float* spectrum,
+                               float indexParam, int chainTaps, int first) {
+	buildChainTaps(pThis, spectrum, indexParam, chainTaps, first, kN, 1.0f / kN);
+	memset(spectrum + kN, 0, kN * sizeof(float));
+	fftRealInPlace(t, spectrum);
+}
+
+// Transform one partition of a slot's chain tail into the bank's spectra
+// (zero-padded, the 1/B of the inverse transform folded in as in
+// buildSpectra()). part counts through the stages in order.
+static void buildChainPartition(_rainbowAlgorithm* pThis, int b, int ch, int part) {
+	const KernelBank* bank = &pThis->dtc->banks[b];
+	int s = 0;
+	while (part >= chainPartitions(bank->chainTaps, s)) {
+		part -= chainPartitions(bank->chainTaps, s++);
+	}
+	float* spectrum = pThis->chainChannels[ch].spectra[s][b] + part * (kChainBlock[s] + 1) * 2;
+	const int first = kChainStart[s] + part * kChainBlock[s];
+	const float indexParam = channelIndex(pThis, ch);
+	if (s == 0) {
+		buildChainSpectrum(&pThis->chain->tables0, pThis, spectrum, indexParam, bank->chainTaps, first);
+	} else {
+		buildChainSpectrum(&pThis->chain->tables1, pThis, spectrum, indexParam, bank->chainTaps, first);
+	}
+}
+
+// ----------------------------------------------------------------------------
+// Silence detection
+// ----------------------------------------------------------------------------
+
+// Track one channel's input over the block; returns true if it is idle.
+// A channel goes idle once its input has stayed below kSilenceThreshold
+// for the length of its wet tail. Its delay lines are cleared then, so no
+// residue (or denormals) is left to ring out when the input returns.
+static bool updateIdle(_rainbowAlgorithm* pThis, int ch, const float* in, int numFrames, int tail) {
+	ChannelState* state = &pThis->dtc->channels[ch];
+	FftChannel* fc = &pThis->fftChannels[ch];
+	float peak = 0.0f;
+	for (int i = 0; i < numFrames; ++i) {
+		peak = std::max(peak, fabsf(in[i]));
+	}
+	if (peak >= kSilenceThreshold) {
+		state->silentFrames = 0;
+		state->idle = fc->idle = false;
+		return false;
+	}
+	
+	if (!state->idle && state->silentFrames >= tail) {
+		const int maxKernelSize = kKernelSizes[pThis->maxSizeIndex];
+		memset(state->delayLine, 0, 2 * maxKernelSize * sizeof(float));
+		const int fixedSize = std::min(maxKernelSize, kMaxFixedKernelSize);
+		if (state->delayLineQ15) memset(state->delayLineQ15, 0, 2 * fixedSize * sizeof(int16_t));
+		if (state->halfBandLine) memset(state->halfBandLine, 0, 2 * fixedSize * sizeof(float));
+		memset(fc->fdl, 0, sizeof(fc->fdl));
+		memset(fc->input, 0, sizeof(fc->input));
+		memset(fc->output, 0, sizeof(fc->output));
+		memset(fc->outputNew, 0, sizeof(fc->outputNew));
+		if (pThis->chain) clearChainChannel(pThis->chain, &pThis->chainChannels[ch]);
+		state->idle = fc->idle = true;
+	}
+	state->silentFrames = std::min(state->silentFrames + numFrames, tail);
+	return state->idle;
+}
+
+// ----------------------------------------------------------------------------
+// Kernel handoff
+//
+// Producer: step()'s kernel job, which never waits (deserialise() stages
+// a preset's kernels for it). Consumer: step(). The producer never touches
+// the front or fade bank, the consumer never touches a bank that is being
+// written, and a new set is only picked up at a block boundary.
+// ----------------------------------------------------------------------------
+
+// Producer: claim a bank to build into, or -1 if none is free. A
+// publication that step() has not picked up yet is retracted and rebuilt
+// (latest wins), keeping its crossfade request.
+static int tryAcquireBank(_rainbow_DTC* dtc, bool& crossfade) {
+	for (int b = 0; b < kNumKernelBanks; ++b) {
+		int expected = kBankReady;
+		if (dtc->bankState[b].compare_exchange_strong(expected, kBankWriting, std::memory_order_acquire)) {
+			crossfade = dtc->banks[b].crossfade;
+			return b;
+		}
+	}
+	for (int b = 0; b < kNumKernelBanks; ++b) {
+		int expected = kBankFree;
+		if (dtc->bankState[b].compare_exchange_strong(expected, kBankWriting, std::memory_order_acquire)) {
+			crossfade = false;
+			return b;
+		}
+	}
+	return -1;
+}
+
+static void publishBank(_rainbow_DTC* dtc, int b) {
+	dtc->banks[b].sequence = dtc->generation.load(std::memory_order_relaxed) + 1;
+	dtc->bankState[b].store(kBankReady, std::memory_order_release);
+	dtc->generation.fetch_add(1, std::memory_order_release);
+}
+
+// Consumer: switch the playing kernel size. The delay lines are laid out
+// for Max Resolution, so their history carries over, but the Q15 and
+// half-band lines are only written by the direct form: entering it from
+// the FFT engine, they are rebuilt from the float line. The FFT engine
+// starts clear unless it was kept fed (warm, see feedFftInput()).
+static void setPlayingKernelSize(_rainbowAlgorithm* pThis, int kernelSize, bool warm) {
+	_rainbow_DTC* dtc = pThis->dtc;
+	const bool fromFft = useFftEngine(dtc->kernelSize);
+	dtc->kernelSize = kernelSize;
+	if (!warm) resetFft(pThis->fft, pThis->fftChannels, pThis->numChannels);
+	if (!fromFft || useFftEngine(kernelSize) || pThis->maxEngine == kDirectFloat)
+		return;
+	
+	const int lineSize = dtc->lineSize;
+	const int fixedSize = std::min(lineSize, kMaxFixedKernelSize);
+	for (int ch = 0; ch < pThis->numChannels; ++ch) {
+		ChannelState* state = &dtc->channels[ch];
+		for (int k = fixedSize; k > 0; --k) {
+			const int pos = (state->writePos - k) & (lineSize - 1);
+			const int q = pos & (fixedSize - 1);
+			state->delayLineQ15[q] = state->delayLineQ15[q + fixedSize] = sampleToQ15(state->delayLine[pos]);
+			if (state->halfBandLine)
+				state->halfBandLine[q] = state->halfBandLine[q + fixedSize] = halfBandSample(&state->delayLine[pos + lineSize]);
+		}
+	}
+}
+
+// Consumer: redo the FFT output block being played with a bank that has
+// just come in (into outputNew as the second), from the delay line, so it
+// takes effect from the current frame rather than the next block. Only
+// the channels marked secondPass if marked.
+static void replayFftBank(_rainbowAlgorithm* pThis, int b, bool second, bool marked) {
+	FftEngine* fft = pThis->fft;
+	const KernelBank* bank = &pThis->dtc->banks[b];
+	fftConvolveBank(fft, pThis->fftChannels, pThis->numChannels, bankPartitions(bank), bankHead(fft, bank),
+	                (fft->fdlPos - 1) & (kMaxPartitions - 1), b, bank->shared, second, marked, pThis->dtc->hotOffset);
+}
+
+// Consumer: mark the channels whose kernel differs between the playing
+// bank and the one replacing it. Only those run the second convolution,
+// each with its own ramp; returns false if none does.
+static bool startCrossfade(_rainbowAlgorithm* pThis, const KernelBank* from, const KernelBank* to) {
+	bool any = false;
+	for (int ch = 0; ch < pThis->numChannels; ++ch) {
+		ChannelState* state = &pThis->dtc->channels[ch];
+		state->crossfading = !sameKernel(from->keys[from->shared ? 0 : ch], to->keys[to->shared ? 0 : ch]);
+		state->crossfadeMix = 0.0f;
+		any |= state->crossfading;
+	}
+	return any;
+}
+
+// Consumer: the crossfade can start mid FFT block. Without the new bank's
+// output for it, the ramp would blend the old output with itself and jump
+// at the next block.
+static void replayCrossfade(_rainbowAlgorithm* pThis) {
+	for (int ch = 0; ch < pThis->numChannels; ++ch) {
+		pThis->fftChannels[ch].secondPass = pThis->dtc->channels[ch].crossfading;
+	}
+	replayFftBank(pThis, pThis->dtc->frontBank, true, true);
+	for (int ch = 0; ch < pThis->numChannels; ++ch) {
+		FftChannel* fc = &pThis->fftChannels[ch];
+		fc->newValid = fc->secondPass && !fc->idle;
+	}
+}
+
+// Kernel size changes
+//
+// A bank of another size crossfades in at the larger of the two sizes,
+// the shorter kernel playing zero-padded: through its spectra in the FFT
+// engine (built by step() for a direct-form size, which keeps its zero
+// latency there, see bankHead()), direct-form otherwise. The playing size
+// follows the front bank once the crossfade is over.
+//
+// Entering the FFT engine, the direct form feeds it input for as many
+// blocks as the longer kernel has partitions, so the delay line it takes
+// over at a block boundary is complete.
+
+// Direct form, ahead of entering the FFT engine: feed one channel's input
+// to it as fftPass() would, transforming each completed block into the
+// frequency-domain delay line. The block position advances once every
+// channel has been fed (see advanceFftFeed()).
+static void feedFftInput(const FftEngine* e, FftChannel* fc, const float* in, int numFrames) {
+	int fill = e->fill;
+	int pos = e->fdlPos;
+	for (int i = 0; i < numFrames; ) {
+		const int n = std::min(numFrames - i, kFftBlockSize - fill);
+		memcpy(fc->input + kFftBlockSize + fill, in + i, n * sizeof(float));
+		i += n;
+		fill += n;
+		if (fill == kFftBlockSize) {
+			fftReal(e, fc->input, fc->fdl[pos]);
+			memcpy(fc->input, fc->input + kFftBlockSize, kFftBlockSize * sizeof(float));
+			pos = (pos + 1) & (kMaxPartitions - 1);
+			fill = 0;
+		}
+	}
+}
+
+static void advanceFftFeed(_rainbowAlgorithm* pThis, int numFrames) {
+	FftEngine* fft = pThis->fft;
+	const int blocks = (fft->fill + numFrames) / kFftBlockSize;
+	fft->fill = (fft->fill + numFrames) % kFftBlockSize;
+	fft->fdlPos = (fft->fdlPos + blocks) & (kMaxPartitions - 1);
+	pThis->dtc->warmBlocks += blocks;
+}
+
+// Consumer: claim a bank of another size while playing, and start feeding
+// the FFT engine if it is to be entered, from a block whose first half of
+// input comes from the float line
+static void beginSizeChange(_rainbowAlgorithm* pThis, int b) {
+	_rainbow_DTC* dtc = pThis->dtc;
+	dtc->bankState[b].store(kBankNext, std::memory_order_relaxed);
+	dtc->nextBank = b;
+	dtc->nextSpectra = 0;
+	dtc->warmBlocks = -1;
+	if (useFftEngine(dtc->kernelSize) || !useFftEngine(dtc->banks[b].kernelSize))
+		return;
+	
+	for (int ch = 0; ch < pThis->numChannels; ++ch) {
+		const ChannelState* state = &dtc->channels[ch];
+		float* input = pThis->fftChannels[ch].input;
+		for (int i = 0; i < kFftBlockSize; ++i) {
+			input[i] = state->delayLine[(state->writePos - kFftBlockSize + i) & (dtc->lineSize - 1)];
+		}
+	}
+	pThis->fft->fill = 0;
+	dtc->warmBlocks = 0;
+}
+
+// Consumer: drop a size change that has not started (morph takes both banks)
+static void cancelSizeChange(_rainbow_DTC* dtc) {
+	if (dtc->nextBank < 0)
+		return;
+	dtc->bankState[dtc->nextBank].store(kBankFree, std::memory_order_release);
+	dtc->nextBank = -1;
+	dtc->warmBlocks = -1;
+}
+
+// Consumer: once the bank claimed by beginSizeChange() can play, start
+// crossfading into it (every channel: the kernel size is in the key).
+// Spectra are built a few channels a block.
+static void continueSizeChange(_rainbowAlgorithm* pThis) {
+	_rainbow_DTC* dtc = pThis->dtc;
+	const int b = dtc->nextBank;
+	KernelBank* from = &dtc->banks[dtc->frontBank];
+	KernelBank* to = &dtc->banks[b];
+	const int size = std::max(from->kernelSize, to->kernelSize);
+	const bool entering = dtc->warmBlocks >= 0;
+	if (useFftEngine(size)) {
+		const int shorter = from->kernelSize < to->kernelSize ? dtc->frontBank : b;
+		const KernelBank* bank = &dtc->banks[shorter];
+		const int numKernels = bank->shared ? 1 : pThis->numChannels;
+		for (int n = 0; n < kSizeChangeSpectraPerBlock && dtc->nextSpectra < numKernels
+		                && !useFftEngine(bank->kernelSize); ++n, ++dtc->nextSpectra) {
+			buildSpectra(pThis->fft, bank->kernels[dtc->nextSpectra], bank->kernelSize,
+			             pThis->fftChannels[dtc->nextSpectra].spectra[shorter]);
+		}
+		if (dtc->nextSpectra < numKernels && !useFftEngine(bank->kernelSize))
+			return;
+		if (entering && (dtc->warmBlocks < bankPartitions(to) || pThis->fft->fill != 0))
+			return;
+	}
+	
+	dtc->nextBank = -1;
+	dtc->warmBlocks = -1;
+	if (pThis->chain) releaseChain(pThis->chain, dtc, pThis->numChannels);
+	if (size != dtc->kernelSize) setPlayingKernelSize(pThis, size, true);
+	startCrossfade(pThis, from, to);
+	dtc->bankState[dtc->frontBank].store(kBankFade, std::memory_order_relaxed);
+	dtc->bankState[b].store(kBankFront, std::memory_order_relaxed);
+	dtc->fadeBank = dtc->frontBank;
+	dtc->frontBank = b;
+	dtc->crossfading = true;
+	if (useFftEngine(size)) {
+		// Entering, the engine has yet to build the old bank's output
+		if (entering) replayFftBank(pThis, dtc->fadeBank, false, false);
+		replayCrossfade(pThis);
+	}
+}
+
+// Consumer: switch to (or start crossfading into) the latest published
+// bank, or carry on with a size change
+static void pickUpKernels(_rainbowAlgorithm* pThis) {
+	_rainbow_DTC* dtc = pThis->dtc;
+	if (dtc->nextBank >= 0) {
+		continueSizeChange(pThis);
+		return;
+	}
+	if (dtc->fadeBank < 0 && dtc->banks[dtc->frontBank].kernelSize != dtc->kernelSize) {
+		setPlayingKernelSize(pThis, dtc->banks[dtc->frontBank].kernelSize, true);  // a size crossfade ended
+	}
+	
+	const uint32_t generation = dtc->generation.load(std::memory_order_acquire);
+	if (generation == dtc->consumedGeneration || dtc->fadeBank >= 0)
+		return;
+	
+	int b = -1;
+	for (int i = 0; i < kNumKernelBanks; ++i) {
+		if (dtc->bankState[i].load(std::memory_order_acquire) != kBankReady)
+			continue;
+		if (b < 0 || (int32_t)(dtc->banks[i].sequence - dtc->banks[b].sequence) > 0)
+			b = i;
+	}
+	if (b < 0) {
+		dtc->consumedGeneration = generation;  // retracted for a rebuild
+		return;
+	}
+	int expected = kBankReady;
+	if (!dtc->bankState[b].compare_exchange_strong(expected, kBankFront, std::memory_order_acq_rel))
+		return;
+	dtc->consumedGeneration = generation;
+	
+	// Anything published before it is superseded
+	for (int i = 0; i < kNumKernelBanks; ++i) {
+		expected = kBankReady;
+		dtc->bankState[i].compare_exchange_strong(expected, kBankFree, std::memory_order_acq_rel);
+	}
+	
+	const KernelBank* bank = &dtc->banks[b];
+	if (bank->kernelSize != dtc->kernelSize) {
+		if (dtc->banks[dtc->frontBank].numTaps > 0) {  // not the initial empty bank
+			beginSizeChange(pThis, b);
+			continueSizeChange(pThis);
+			return;
+		}
+		setPlayingKernelSize(pThis, bank->kernelSize, false);
+		if (pThis->chain) releaseChain(pThis->chain, dtc, pThis->numChannels);
+		dtc->bankState[dtc->frontBank].store(kBankFree, std::memory_order_release);
+	} else if (bank->crossfade && startCrossfade(pThis, &dtc->banks[dtc->frontBank], bank)) {
+		dtc->bankState[dtc->frontBank].store(kBankFade, std::memory_order_relaxed);
+		dtc->fadeBank = dtc->frontBank;
+		dtc->crossfading = true;
+		dtc->frontBank = b;
+		if (useFftEngine(dtc->kernelSize)) replayCrossfade(pThis);
+		return;
+	} else if (dtc->chainRefs[dtc->frontBank] > 0) {
+		// The chain tail keeps convolving earlier input with it
+		dtc->bankState[dtc->frontBank].store(kBankFade, std::memory_order_relaxed);
+		dtc->fadeBank = dtc->frontBank;
+	} else {
+		dtc->bankState[dtc->frontBank].store(kBankFree, std::memory_order_release);
+	}
+	dtc->frontBank = b;
+}
+
+// Consumer: release the fade bank back to the producer, once the chain
+// tail has no more input to convolve with it
+static void releaseFadeBank(_rainbow_DTC* dtc) {
+	dtc->crossfading = false;
+	if (dtc->fadeBank < 0 || dtc->chainRefs[dtc->fadeBank] > 0)
+		return;
+	dtc->bankState[dtc->fadeBank].store(kBankFree, std::memory_order_release);
+	dtc->fadeBank = -1;
+}
+
+// Consumer: claim a second bank for the odd morph slot
+static bool acquireFadeBank(_rainbow_DTC* dtc) {
+	if (dtc->fadeBank >= 0)
+		return true;
+	for (int b = 0; b < kNumKernelBanks; ++b) {
+		int expected = kBankFree;
+		if (dtc->bankState[b].compare_exchange_strong(expected, kBankFade, std::memory_order_acquire)) {
+			dtc->fadeBank = b;
+			return true;
+		}
+	}
+	for (int b = 0; b < kNumKernelBanks; ++b) {
+		int expected = kBankReady;
+		if (dtc->bankState[b].compare_exchange_strong(expected, kBankFade, std::memory_order_acquire)) {
+			dtc->fadeBank = b;
+			return true;
+		}
+	}
+	return false;  // the producer is mid-build; try again next block
+}
+
+// Audio-rate morph
+//
+// Convolution is linear, so convolving with two neighbouring waves and
+// blending the outputs equals convolving with the blended kernel. Index can
+// then move anywhere between the pair without a rebuild; crossing into the
+// next pair replaces only the slot that falls out of it, and the slot that
+// stays holds exactly the wave at the boundary. Morph slots belong to
+// step(), which builds them itself.
+
+static void invalidateMorph(_rainbowAlgorithm* pThis) {
+	_rainbow_DTC* dtc = pThis->dtc;
+	for (int ch = 0; ch < kMaxChannels; ++ch) {
+		dtc->morphWave[ch] = -1;
+	}
+	dtc->morphSnap = true;
+}
+
+RAINBOW_HOT_INLINE static inline float morphOffset(float index, int numWaves) {
+	return std::max(0.0f, std::min(index, 1.0f)) * (numWaves - 1);
+}
+
+// Blend from the front (even) bank towards the fade (odd) bank for an
+// offset near the pair
+RAINBOW_HOT_INLINE static inline float morphMix(float offset, int pairWave) {
+	float f = std::max(0.0f, std::min(offset - pairWave, 1.0f));
+	return (pairWave & 1) ? 1.0f - f : f;
+}
+
+// Empty a channel's morph slot until its pair is built: no taps, and with
+// spectra, silent partitions up to kernelSize
+static void clearMorphSlot(_rainbowAlgorithm* pThis, int b, int ch, int kernelSize, bool spectra) {
+	KernelBank* bank = &pThis->dtc->banks[b];
+	bank->taps[ch] = 0;
+	bank->form[ch] = kFormPlain;
+	bank->keys[ch].cacheStamp = 0;
+	if (spectra) {
+		memset(pThis->fftChannels[ch].spectra[b], 0,
+		       kernelSize / kFftBlockSize * sizeof(pThis->fftChannels[ch].spectra[b][0]));
+	}
+}
+
+// Consumer: own both banks and load the wave pair around each channel's
+// position (called once per block), within kMorphTapsPerFrame. Returns
+// false if morphing has to wait.
+static bool updateMorphKernels(_rainbowAlgorithm* pThis, float cvOffset, int numFrames) {
+	if (loadedWaves(pThis) == 0)
+		return false;
+	
+	_rainbow_DTC* dtc = pThis->dtc;
+	if (dtc->crossfading) {
+		// Keep the crossfade source as the odd slot and start afresh
+		dtc->crossfading = false;
+		invalidateMorph(pThis);
+	}
+	if (!acquireFadeBank(dtc))
+		return false;
+	
+	const uint32_t morphGeneration = dtc->morphGeneration.load(std::memory_order_acquire);
+	if (morphGeneration != dtc->consumedMorphGeneration) {
+		dtc->consumedMorphGeneration = morphGeneration;
+		invalidateMorph(pThis);
+		if (pThis->kernelSize != dtc->kernelSize)
+			setPlayingKernelSize(pThis, pThis->kernelSize, false);
+	}
+	
+	const int numWaves = loadedWaves(pThis);
+	const int kernelSize = dtc->kernelSize;
+	const bool shared = isSharedKernel(pThis);
+	const int numKernels = shared ? 1 : pThis->numChannels;
+	const int slotBank[2] = { dtc->frontBank, dtc->fadeBank };
+	
+	// A channel waiting for its pair (-1) plays the front bank's kernel
+	// while that still fits the instance, and silence otherwise. It blends
+	// nothing from the fade slot, whose spectra may stay stale.
+	const KernelBank* front = &dtc->banks[slotBank[0]];
+	const bool frontPlays = front->kernelSize == kernelSize && front->chainTaps == 0 && (!front->shared || shared);
+	for (int ch = 0; ch < numKernels; ++ch) {
+		if (dtc->morphWave[ch] >= 0)
+			continue;
+		if (!frontPlays) clearMorphSlot(pThis, slotBank[0], ch, kernelSize, useFftEngine(kernelSize));
+		clearMorphSlot(pThis, slotBank[1], ch, kernelSize, false);
+	}
+	
+	const int budget = numFrames * kMorphTapsPerFrame;
+	int spent = 0;
+	bool rebuilt[2] = { false, false };
+	bool replay[2][kMaxChannels] = {};
+	dtc->morphPending = false;
+	for (int ch = 0; ch < numKernels; ++ch) {
+		float offset = morphOffset(channelIndex(pThis, ch) + cvOffset, numWaves);
+		int pair = std::min((int)offset, std::max(numWaves - 2, 0));
+		int old = dtc->morphWave[ch];
+		if (pair == old)
+			continue;
+		if (spent >= budget) {
+			dtc->morphPending = true;
+			break;
+		}
+		
+		for (int w = pair; w <= pair + 1; ++w) {
+			if (old >= 0 && (w == old || w == old + 1))
+				continue;  // already in its slot
+			
+			const int b = slotBank[w & 1];
+			const int wave = std::min(w, numWaves - 1);
+			float* kernel = dtc->banks[b].kernels[ch];
+			dtc->banks[b].kernelSize = kernelSize;
+			dtc->banks[b].taps[ch] = buildKernel(pThis, kernel, kernelSize, wave, wave, 0.0f);
+			dtc->banks[b].keys[ch].cacheStamp = 0;
+			prepareKernel(pThis, b, ch);
+			rebuilt[w & 1] = true;
+			replay[w & 1][ch] = true;
+			spent += kernelSize;
+		}
+		dtc->morphWave[ch] = pair;
+	}
+	
+	for (int slot = 0; slot < 2; ++slot) {
+		KernelBank* bank = &dtc->banks[slotBank[slot]];
+		bank->kernelSize = kernelSize;
+		bank->chainTaps = 0;
+		bank->shared = shared;
+		bank->numTaps = 0;
+		for (int ch = 0; ch < numKernels; ++ch) {
+			bank->numTaps = std::max(bank->numTaps, bank->taps[ch]);
+		}
+	}
+	
+	// The FFT output block being played was built from the old slot; redo
+	// it from the delay line, for the channels rebuilt (every channel if
+	// they share), so the new wave takes effect immediately
+	if (useFftEngine(kernelSize)) {
+		for (int slot = 0; slot < 2; ++slot) {
+			if (!rebuilt[slot])
+				continue;
+			for (int ch = 0; ch < pThis->numChannels; ++ch) {
+				pThis->fftChannels[ch].secondPass = replay[slot][shared ? 0 : ch];
+			}
+			replayFftBank(pThis, slotBank[slot], slot == 1, true);
+		}
+		if (rebuilt[1]) {
+			for (int ch = 0; ch < pThis->numChannels; ++ch) {
+				pThis->fftChannels[ch].newValid = true;
+			}
+		}
+	}
+	
+	// Unused slots are stale once channels share; rebuild them if Spread opens up
+	for (int ch = numKernels; ch < pThis->numChannels; ++ch) {
+		dtc->morphWave[ch] = -1;
+	}
+	return true;
+}
+
+// ----------------------------------------------------------------------------
+// Kernel job
+//
+// Kernel sets are built by step() itself, after the audio, within
+// kKernelJobShare of each block's duration: the cache rows one wave per
+// item, then the bank one channel per item. parameterChanged(), the
+// wavetable callback and the governor only post requests. A request that
+// arrives mid-job restarts it from the earliest stage it needs (slots of
+// the bank already built are kept where their keys still match), and the
+// bank is published only once complete, so step() never plays a partial
+// set.
+// ----------------------------------------------------------------------------
+
+static void requestKernels(_rainbowAlgorithm* pThis, int flags) {
+	pThis->jobRequest.fetch_or(flags, std::memory_order_release);
+}
+
+static void releaseJobBank(_rainbowAlgorithm* pThis) {
+	KernelJob* job = &pThis->job;
+	if (job->bank < 0)
+		return;
+	pThis->dtc->bankState[job->bank].store(kBankFree, std::memory_order_release);
+	job->bank = -1;
+}
+
+// (Re)start filling the job's bank at the job's kernel size
+static void beginJobBank(_rainbowAlgorithm* pThis) {
+	KernelJob* job = &pThis->job;
+	KernelBank* bank = &pThis->dtc->banks[job->bank];
+	bank->kernelSize = job->kernelSize;
+	bank->chainTaps = job->kernelSize == kMaxKernelSize ? chainLength(pThis) : 0;
+	bank->shared = isSharedKernel(pThis);
+	bank->numTaps = 0;
+	job->numItems = (bank->shared ? 1 : pThis->numChannels) * kernelParts(bank);
+	job->next = 0;
+}
+
+// Enter the earliest stage the job's flags still need
+static void startJobStage(_rainbowAlgorithm* pThis) {
+	KernelJob* job = &pThis->job;
+	job->kernelSize = pThis->kernelSize;
+	job->next = 0;
+	const bool cached = pThis->cacheKernelSize.load(std::memory_order_relaxed) == job->kernelSize;
+	if (job->flags & kJobPreset) {
+		job->stage = kStagePreset;  // before the table, which crossfades in over it
+	} else if (loadedWaves(pThis) == 0 || job->flags == 0) {
+		releaseJobBank(pThis);
+		job->flags = 0;
+		job->stage = kStageIdle;
+	} else if ((job->flags & kJobCache) || !cached) {
+		releaseJobBank(pThis);
+		pThis->cacheKernelSize.store(0, std::memory_order_release);
+		job->stage = kStageCache;
+		job->numItems = std::min(loadedWaves(pThis), kMaxCachedWaves);
+	} else if (job->flags & kJobMeasure) {
+		releaseJobBank(pThis);
+		job->stage = kStageMeasure;
+		job->numItems = pThis->cacheNumWaves;
+	} else {
+		job->stage = kStageKernels;
+		if (job->bank >= 0) beginJobBank(pThis);
+	}
+}
+
+// Kernels stage: one slot per call. Returns false to wait for the next block.
+static bool runKernelsItem(_rainbowAlgorithm* pThis) {
+	KernelJob* job = &pThis->job;
+	_rainbow_DTC* dtc = pThis->dtc;
+	if (dtc->morph) {
+		// Morph slots are built by step() from the cache as Index moves
+		releaseJobBank(pThis);
+		dtc->morphGeneration.fetch_add(1, std::memory_order_release);
+		job->flags = 0;
+		job->stage = kStageIdle;
+		return true;
+	}
+	
+	if (job->bank < 0) {
+		// step() holds at most two banks while a crossfade runs
+		bool pendingCrossfade;
+		if (dtc->fadeBank >= 0 || (job->bank = tryAcquireBank(dtc, pendingCrossfade)) < 0)
+			return false;
+		if (pendingCrossfade) job->flags |= kJobCrossfade;
+		beginJobBank(pThis);
+	}
+	
+	// A chain's slot only matches its key again once its tail is complete
+	KernelBank* bank = &dtc->banks[job->bank];
+	const int parts = kernelParts(bank);
+	const int ch = job->next / parts;
+	const int part = job->next % parts;
+	if (part > 0) {
+		buildChainPartition(pThis, job->bank, ch, part - 1);
+		if (part == parts - 1) bank->keys[ch] = job->chainKey;
+	} else if (!buildBankSlot(pThis, job->bank, ch)) {
+		job->next += parts - 1;  // kept, tail and all
+	} else if (parts > 1) {
+		job->chainKey = bank->keys[ch];
+		bank->keys[ch].cacheStamp = 0;
+	}
+	if (++job->next < job->numItems)
+		return true;
+	
+	// Complete; a request posted meanwhile restarts it on the next block
+	if (pThis->jobRequest.load(std::memory_order_acquire) != 0)
+		return false;
+	bank->crossfade = (job->flags & kJobCrossfade) != 0;
+	publishBank(dtc, job->bank);
+	pThis->currentIndexParam = pThis->v[kParamIndex] * 0.001f;
+	job->published = job->bank;
+	job->bank = -1;
+	job->flags = 0;
+	job->stage = kStageResponse;
+	return true;
+}
+
+// Copy the staged preset kernels into bank b; false if deserialise() has
+// retracted them
+static bool takePresetKernels(_rainbowAlgorithm* pThis, int b) {
+	PresetKernels* preset = &pThis->preset;
+	int expected = kPresetReady;
+	if (!preset->state.compare_exchange_strong(expected, kPresetTaking, std::memory_order_acquire))
+		return false;
+	
+	const int maxKernelSize = kKernelSizes[pThis->maxSizeIndex];
+	KernelBank* bank = &pThis->dtc->banks[b];
+	const int numKernels = preset->shared ? 1 : pThis->numChannels;
+	bank->numTaps = 0;
+	for (int ch = 0; ch < numKernels; ++ch) {
+		const int16_t* q = preset->taps + ch * maxKernelSize;
+		const int taps = preset->numTaps[ch];
+		const float scale = ldexpf(1.0f, -preset->shift[ch]);
+		float* kernel = bank->kernels[ch];
+		for (int i = 0; i < taps; ++i) {
+			kernel[i] = q[i] * scale;
+		}
+		memset(kernel + taps, 0, (maxKernelSize - taps) * sizeof(float));
+		bank->taps[ch] = taps;
+		bank->keys[ch].cacheStamp = 0;
+		bank->numTaps = std::max(bank->numTaps, taps);
+	}
+	bank->kernelSize = preset->kernelSize;
+	bank->chainTaps = 0;
+	bank->shared = preset->shared;
+	preset->state.store(kPresetEmpty, std::memory_order_release);
+	return true;
+}
+
+// Preset stage: the staged kernels into a bank, then one slot prepared per
+// call. Returns false to wait for the next block.
+static bool runPresetItem(_rainbowAlgorithm* pThis) {
+	KernelJob* job = &pThis->job;
+	_rainbow_DTC* dtc = pThis->dtc;
+	if (job->next == 0) {
+		if (!dtc->morph && job->bank < 0) {
+			bool pendingCrossfade;
+			if (dtc->fadeBank >= 0 || (job->bank = tryAcquireBank(dtc, pendingCrossfade)) < 0)
+				return false;
+			if (pendingCrossfade) job->flags |= kJobCrossfade;
+		}
+		// Morph slots are built from the cache, which only the table fills.
+		// Kernels retracted for a newer preset are requested again.
+		if (dtc->morph || !takePresetKernels(pThis, job->bank)) {
+			job->flags &= ~kJobPreset;
+			startJobStage(pThis);
+			return true;
+		}
+		job->numItems = dtc->banks[job->bank].shared ? 1 : pThis->numChannels;
+	}
+	
+	prepareKernel(pThis, job->bank, job->next);
+	if (++job->next < job->numItems)
+		return true;
+	
+	dtc->banks[job->bank].crossfade = false;
+	publishBank(dtc, job->bank);
+	job->published = job->bank;
+	job->bank = -1;
+	job->flags &= ~kJobPreset;
+	job->stage = kStageResponse;
+	return true;
+}
+
+// One item of the current stage. Returns false to wait for the next block.
+static bool runJobItem(_rainbowAlgorithm* pThis) {
+	KernelJob* job = &pThis->job;
+	switch (job->stage) {
+	case kStageCache:
+		buildCacheRow(pThis, job->next, job->kernelSize);
+		if (++job->next == job->numItems) {
+			pThis->cacheNumWaves = job->numItems;
+			if (++pThis->cacheStamp == 0) pThis->cacheStamp = 1;
+			pThis->cacheKernelSize.store(job->kernelSize, std::memory_order_release);
+			job->flags &= ~(kJobCache | kJobMeasure);
+			startJobStage(pThis);
+		}
+		return true;
+		
+	case kStageMeasure:
+		pThis->cacheTaps[job->next] = effectiveTaps(pThis->kernelCache + job->next * job->kernelSize,
+		                                            job->kernelSize, pThis->v[kParamEnergy] * 0.001f);
+		if (++job->next == job->numItems) {
+			if (++pThis->cacheStamp == 0) pThis->cacheStamp = 1;
+			job->flags &= ~kJobMeasure;
+			startJobStage(pThis);
+		}
+		return true;
+		
+	case kStageKernels:
+		return runKernelsItem(pThis);
+		
+	case kStagePreset:
+		return runPresetItem(pThis);
+		
+	case kStageResponse:
+		{
+			const KernelBank* bank = &pThis->dtc->banks[job->published];
+			const int back = pThis->responseFront.load(std::memory_order_relaxed) == 0 ? 1 : 0;
+			measureResponse(pThis, bank->kernels[0], bank->taps[0], bank->kernelSize, pThis->response[back]);
+			pThis->responseFront.store(back, std::memory_order_release);
+			job->stage = kStageIdle;
+			if (job->flags) startJobStage(pThis);  // taken while the preset was
+		}
+		return true;
+	}
+	return false;
+}
+
+// Take new requests, at the start of step(): a wavetable load invalidates
+// the cache before anything in the block reads it
+static void takeKernelRequests(_rainbowAlgorithm* pThis) {
+	const int request = pThis->jobRequest.exchange(0, std::memory_order_acquire);
+	if (request != 0) {
+		pThis->job.flags |= request;
+		// A preset's slots are finished first, unless a newer one is staged
+		if (pThis->job.stage != kStagePreset || (request & kJobPreset)) startJobStage(pThis);
+	}
+}
+
+// Advance the job within the block's share of time (at least one item
+// per block), after the audio. Host builds count items instead.
+static void runKernelJob(_rainbowAlgorithm* pThis, int numFrames) {
+	KernelJob* job = &pThis->job;
+	if (job->stage == kStageIdle)
+		return;
+	
+	const uint32_t start = readCycleCounter();
+#if defined(__arm__)
+	const uint32_t budget = (uint32_t)(numFrames * kKernelJobShare * (kCyclesPerSecond / NT_globals.sampleRate));
+	while (runJobItem(pThis) && job->stage != kStageIdle && readCycleCounter() - start < budget) {
+	}
+#else
+	const int budget = std::max(1, numFrames / kKernelJobHostFrames);
+	for (int items = 1; runJobItem(pThis) && job->stage != kStageIdle && items < budget; ++items) {
+	}
+	(void)start;
+#endif
+#ifdef RAINBOW_PROFILE
+	profileRecord(&pThis->profile[kProfileKernelBuild], (float)(readCycleCounter() - start));
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// CPU governor
+// ----------------------------------------------------------------------------
+
+// Consumer: move new kernel sets to the governor's size. The job builds
+// them, and step() adopts the size along with the first one.
+static bool setAutoSize(_rainbowAlgorithm* pThis, int sizeIndex) {
+	if (loadedWaves(pThis) == 0)
+		return false;
+	pThis->dtc->autoSize.store(sizeIndex, std::memory_order_relaxed);
+	pThis->kernelSize = kKernelSizes[sizeIndex];
+	requestKernels(pThis, kJobKernels);
+	return true;
+}
+
+// Consumer: fold one block's cost into the average and step the kernel
+// size down when over budget, or up when well under it and the next size
+// is not locked out
+static void runGovernor(_rainbowAlgorithm* pThis, uint32_t cycles, int numFrames) {
+	_rainbow_DTC* dtc = pThis->dtc;
+	const float sampleRate = NT_globals.sampleRate;
+	dtc->clock += numFrames;
+	
+	// Crossfades and the run-up to a size change are transient; don't let them count
+	if (dtc->crossfading || dtc->nextBank >= 0)
+		return;
+	const float load = cycles * (sampleRate / kCyclesPerSecond) / numFrames;
+	dtc->cpuLoad += (load - dtc->cpuLoad) * (numFrames / kGovernorAverageSamples);
+	
+	if (pThis->v[kParamKernelSize] != kAutoResolution || chainLength(pThis) > 0
+	    || (int32_t)(dtc->clock - dtc->holdUntil) < 0)
+		return;
+	
+	const float budget = pThis->v[kParamCpuBudget] * 0.01f;
+	const int size = dtc->autoSize.load(std::memory_order_relaxed);
+	int target = size;
+	if (dtc->cpuLoad > budget && size > 0) {
+		target = size - 1;
+	} else if (dtc->cpuLoad < budget * kGovernorHeadroom && size < pThis->maxSizeIndex
+	           && (int32_t)(dtc->clock - dtc->lockedUntil[size + 1]) >= 0) {
+		target = size + 1;
+	}
+	if (target == size || !setAutoSize(pThis, target))
+		return;
+	
+	dtc->holdUntil = dtc->clock + (uint32_t)(kGovernorHoldSeconds * sampleRate);
+	if (target < size) {
+		dtc->lockedUntil[size] = dtc->clock + (uint32_t)(dtc->backoff[size] * sampleRate);
+		dtc->backoff[size] = std::min(dtc->backoff[size] * 2, kGovernorMaxBackoffSeconds);
+	}
+}
+
+// ============================================================================
+// PROCESSING STAGES
+// ============================================================================
+//
+// step() picks one specialisation of each stage per channel per block, so
+// the per-sample loops carry no mode branches: a wet stage (direct form,
+// or the FFT engine's output with its optional direct-form head) fills a
+// wet buffer, and an output stage mixes it with the dry signal.
+
+// What the wet stage blends: one bank, a crossfade between two, or the
+// morph pair. Dry skips the convolution (no table, or Depth at 0%).
+enum {
+	kPassDry,
+	kPassSingle,
+	kPassCrossfade,
+	kPassMorph,
+	
+	kNumPasses,
+};
+
+// Direct form: FFT sizes (no Q15 or half-band line), the float engine
+// keeping both lines up to date, or the fixed-point engine
+enum {
+	kQ15None,
+	kQ15Shadow,
+	kQ15Engine,
+	
+	kNumQ15Modes,
+};
+
+// Output mix: general, or Depth at 100% (wet only) or 0% (dry only)
+enum {
+	kMixBlend,
+	kMixWet,
+	kMixDry,
+	
+	kNumMixModes,
+};
+
+// One channel's wet stage state for a block
+struct ChannelPass {
+	ChannelState* state;
+	const KernelBank* bankA;  // played alone, or the crossfade source / even morph wave
+	const KernelBank* bankB;  // crossfade target / odd morph wave
+	int slotA;
+	int slotB;
+	int lineSize;
+	float mix;      // crossfade position, advanced by mixStep per sample
+	float mixStep;  // step of this channel's own fade, 0 when it is not fading
+	float pos;      // morph position, advanced by posStep per sample
+	float posStep;
+	const float* cv;  // Morph CV from the first frame of the call, or NULL
+	int numWaves;
+	int pair;
+#ifdef RAINBOW_PROFILE
+	uint32_t* phaseCycles;
+#endif
+};
+
+// Wet stage state for channel ch from frame first of the block. mix is
+// the crossfade position there; posStart is the morph position at frame 0.
+static void beginPass(ChannelPass& p, _rainbowAlgorithm* pThis, int ch, const KernelBank* a, const KernelBank* b,
+                      float mix, float mixStep, float posStart, int first, int numFrames) {
+	_rainbow_DTC* dtc = pThis->dtc;
+	const float target = channelIndex(pThis, ch);
+	p.state = &dtc->channels[ch];
+	p.bankA = a;
+	p.bankB = b;
+	p.slotA = a->shared ? 0 : ch;
+	p.slotB = b->shared ? 0 : ch;
+	p.lineSize = dtc->lineSize;
+	p.mix = mix;
+	p.mixStep = mixStep;
+	p.posStep = (target - posStart) / numFrames;
+	p.pos = posStart + p.posStep * first;
+	p.cv = NULL;
+	p.numWaves = loadedWaves(pThis);
+	p.pair = dtc->morphWave[p.slotA];
+}
+
+// Blend of one wet sample towards bank B's
+template <int kPass>
+RAINBOW_HOT_INLINE static inline float blendWet(ChannelPass& p, float w, float wNew, int i) {
+	if (kPass == kPassMorph) {
+		const float cvOffset = p.cv ? p.cv[i] * kMorphCvScale : 0.0f;
+		const float mix = morphMix(morphOffset(p.pos + cvOffset, p.numWaves), p.pair);
+		p.pos += p.posStep;
+		return w + (wNew - w) * mix;
+	}
+	if (kPass == kPassCrossfade) {
+		const float mix = p.mix;
+		p.mix += p.mixStep;
+		return w + (wNew - w) * mix;
+	}
+	return w;
+}
+
+// blendWet() over four samples in place
+template <int kPass>
+RAINBOW_HOT_INLINE static inline void blendWet4(ChannelPass& p, float* w, const float* wNew, int i) {
+#ifdef RAINBOW_SIMD
+	if (kPass == kPassCrossfade) {
+		float mix[4];
+		for (int j = 0; j < 4; ++j) {
+			mix[j] = p.mix;
+			p.mix += p.mixStep;
+		}
+		const Vec4 a = v4load(w);
+		v4store(w, v4add(a, v4mul(v4sub(v4load(wNew), a), v4load(mix))));
+		return;
+	}
+#endif
+	for (int j = 0; j < 4; ++j) {
+		w[j] = blendWet<kPass>(p, w[j], wNew[j], i + j);
+	}
+}
+
+// Direct-form wet stage over numFrames (a multiple of four). numFrames and
+// the write position are both multiples of four, so a group never wraps
+// the delay line. Only the upper mirror is written before convolving: the
+// lower copies at wp + 1..3 are still the oldest taps. The Q15 and
+// half-band lines are shorter and wrap the write position at their size.
+template <int kPass, int kQ15, int kForm = kFormPlain>
+RAINBOW_HOT static void directPass(ChannelPass& p, const float* __restrict in, float* __restrict wet, int numFrames) {
+	ChannelState* state = p.state;
+	float* __restrict delay = state->delayLine;
+	int16_t* __restrict delayQ15 = state->delayLineQ15;
+	float* __restrict line = state->halfBandLine;
+	const int lineSize = p.lineSize;
+	const int fixedSize = std::min(lineSize, kMaxFixedKernelSize);
+	const float* __restrict kernel = p.bankA->kernels[p.slotA];
+	const float* __restrict newKernel = p.bankB->kernels[p.slotB];
+	const int16_t* __restrict kernelQ15 = p.bankA->kernelsQ15[p.slotA];
+	const int16_t* __restrict newKernelQ15 = p.bankB->kernelsQ15[p.slotB];
+	const int taps = p.bankA->taps[p.slotA];
+	const int newTaps = p.bankB->taps[p.slotB];
+	const float scale = p.bankA->fixedScale[p.slotA];
+	const float newScale = p.bankB->fixedScale[p.slotB];
+	const int foldStart = p.bankA->foldStart[p.slotA];
+	const float* __restrict ends = p.bankA->halfRateEnds[p.slotA];
+	int wp = state->writePos;
+	
+	// The lines Max Engine left out are not kept
+	const bool keepQ15 = kQ15 == kQ15Engine || (kQ15 == kQ15Shadow && delayQ15);
+	const bool keepLine = kQ15 != kQ15None && line;
+	
+	for (int i = 0; i < numFrames; i += 4) {
+		float dry[4], lined[4];
+		int16_t dryQ15[4];
+		const int fp = wp & (fixedSize - 1);
+		for (int j = 0; j < 4; ++j) {
+			dry[j] = in[i + j];
+			delay[wp + j + lineSize] = dry[j];
+		}
+		if (keepQ15) {
+			for (int j = 0; j < 4; ++j) {
+				dryQ15[j] = sampleToQ15(dry[j]);
+				delayQ15[fp + j + fixedSize] = dryQ15[j];
+			}
+		}
+		if (keepLine) {
+			for (int j = 0; j < 4; ++j) {
+				lined[j] = halfBandSample(&delay[wp + j + lineSize]);
+				line[fp + j + fixedSize] = lined[j];
+			}
+		}
+		
+		float* w = wet + i;
+		if (kPass == kPassDry) {
+			for (int j = 0; j < 4; ++j) w[j] = dry[j];
+		} else {
+			const float* x = &delay[wp + 3 + lineSize];
+			const int16_t* xQ15 = &delayQ15[fp + 3 + fixedSize];
+			PROFILE_START(t0);
+			if (kQ15 == kQ15Engine) {
+				firBlock4Q15(xQ15, kernelQ15, taps, scale, w);
+			} else if (kForm == kFormEven || kForm == kFormOdd) {
+				firBlock4Folded<kForm == kFormOdd>(x, kernel, foldStart, taps, w);
+			} else if (kForm == kFormHalfRate) {
+				float foot[4], tail[4];
+				firBlock4(x, ends, kHalfRateEndTaps, w);
+				firBlock4(x - (taps - kHalfRateEndTaps), ends + kHalfRateEndTaps, kHalfRateEndTaps, foot);
+				firBlock4HalfRate(&line[fp + 3 + fixedSize], kernel + kHalfRateEndTaps / 2, (taps - 6) / 2, tail);
+				for (int j = 0; j < 4; ++j) w[j] += foot[j] + tail[j];
+			} else {
+				firBlock4(x, kernel, taps, w);
+			}
+			PROFILE_ADD(p.phaseCycles[kProfileConvolve], t0);
+			
+			if (kPass != kPassSingle) {
+				PROFILE_START(t1);
+				float wNew[4];
+				if (kQ15 == kQ15Engine) {
+					firBlock4Q15(xQ15, newKernelQ15, newTaps, newScale, wNew);
+				} else {
+					firBlock4(x, newKernel, newTaps, wNew);
+				}
+				blendWet4<kPass>(p, w, wNew, i);
+				PROFILE_ADD(p.phaseCycles[kProfileSecondPass], t1);
+			}
+		}
+		
+		for (int j = 0; j < 4; ++j) delay[wp + j] = dry[j];
+		if (keepQ15) {
+			for (int j = 0; j < 4; ++j) delayQ15[fp + j] = dryQ15[j];
+		}
+		if (keepLine) {
+			for (int j = 0; j < 4; ++j) line[fp + j] = lined[j];
+		}
+		wp = (wp + 4) & (lineSize - 1);
+	}
+	state->writePos = wp;
+}
+
+typedef void (*DirectPassFn)(ChannelPass& p, const float* in, float* wet, int numFrames);
+
+// The specialisations below, in the hot section (see HOT CODE PLACEMENT)
+#define RAINBOW_DIRECT_PASS(...) template RAINBOW_HOT void directPass<__VA_ARGS__>(ChannelPass&, const float*, float*, int);
+RAINBOW_DIRECT_PASS(kPassDry, kQ15None)
+RAINBOW_DIRECT_PASS(kPassDry, kQ15Shadow)
+RAINBOW_DIRECT_PASS(kPassSingle, kQ15None)
+RAINBOW_DIRECT_PASS(kPassSingle, kQ15Shadow)
+RAINBOW_DIRECT_PASS(kPassSingle, kQ15Engine)
+RAINBOW_DIRECT_PASS(kPassCrossfade, kQ15None)
+RAINBOW_DIRECT_PASS(kPassCrossfade, kQ15Shadow)
+RAINBOW_DIRECT_PASS(kPassCrossfade, kQ15Engine)
+RAINBOW_DIRECT_PASS(kPassMorph, kQ15None)
+RAINBOW_DIRECT_PASS(kPassMorph, kQ15Shadow)
+RAINBOW_DIRECT_PASS(kPassMorph, kQ15Engine)
+RAINBOW_DIRECT_PASS(kPassSingle, kQ15Shadow, kFormEven)
+RAINBOW_DIRECT_PASS(kPassSingle, kQ15Shadow, kFormOdd)
+RAINBOW_DIRECT_PASS(kPassSingle, kQ15Shadow, kFormHalfRate)
+#undef RAINBOW_DIRECT_PASS
+
+// By pass and Q15 mode. The dry pass keeps the Q15 and half-band lines
+// whenever they exist, so switching engines or kernel forms is seamless.
+static const DirectPassFn directPasses[kNumPasses][kNumQ15Modes] = {
+	{ directPass<kPassDry, kQ15None>, directPass<kPassDry, kQ15Shadow>, directPass<kPassDry, kQ15Shadow> },
+	{ directPass<kPassSingle, kQ15None>, directPass<kPassSingle, kQ15Shadow>, directPass<kPassSingle, kQ15Engine> },
+	{ directPass<kPassCrossfade, kQ15None>, directPass<kPassCrossfade, kQ15Shadow>, directPass<kPassCrossfade, kQ15Engine> },
+	{ directPass<kPassMorph, kQ15None>, directPass<kPassMorph, kQ15Shadow>, directPass<kPassMorph, kQ15Engine> },
+};
+
+// Single float kernel by its form (the Q15 engine already takes two taps
+// per instruction)
+static const DirectPassFn formPasses[kNumForms] = {
+	directPass<kPassSingle, kQ15Shadow, kFormPlain>,
+	directPass<kPassSingle, kQ15Shadow, kFormEven>,
+	directPass<kPassSingle, kQ15Shadow, kFormOdd>,
+	directPass<kPassSingle, kQ15Shadow, kFormHalfRate>,
+};
+
+// FFT engine wet stage for one segment of a block (up to the next block
+// boundary, a multiple of four frames from fill). Feeds the FFT input and
+// plays out its output. Zero-latency hybrid: the first partition runs
+// direct-form and the FFT output holds only the tail's contribution, for
+// bank A (kHeads bit 0) and bank B (bit 1) each (see bankHead()).
+template <int kPass, int kHeads>
+RAINBOW_HOT static void fftPass(ChannelPass& p, FftChannel* fc, int fill, const float* __restrict in,
+                                float* __restrict wet, int numFrames) {
+	ChannelState* state = p.state;
+	float* __restrict delay = state->delayLine;
+	const int lineSize = p.lineSize;
+	int wp = state->writePos;
+	
+	float* __restrict input = fc->input + kFftBlockSize + fill;
+	const float* __restrict output = fc->output + fill;
+	const float* __restrict outputNew = fc->newValid ? fc->outputNew + fill : output;
+	const float* __restrict kernel = p.bankA->kernels[p.slotA];
+	const float* __restrict newKernel = p.bankB->kernels[p.slotB];
+	const int headTaps = std::min(kFftBlockSize, p.bankA->taps[p.slotA]);
+	const int newHeadTaps = std::min(kFftBlockSize, p.bankB->taps[p.slotB]);
+	
+	for (int j = 0; j < numFrames; j += 4) {
+		float dry[4], wNew[4];
+		float* w = wet + j;
+		for (int k = 0; k < 4; ++k) {
+			dry[k] = in[j + k];
+			delay[wp + k + lineSize] = dry[k];
+			input[j + k] = dry[k];
+			w[k] = output[j + k];
+			wNew[k] = outputNew[j + k];
+		}
+		
+		float head[4];
+		const float* x = &delay[wp + 3 + lineSize];
+		if (kHeads & 1) {
+			PROFILE_START(t0);
+			firBlock4(x, kernel, headTaps, head);
+			for (int k = 0; k < 4; ++k) w[k] += head[k];
+			PROFILE_ADD(p.phaseCycles[kProfileConvolve], t0);
+		}
+		if (kPass != kPassSingle && (kHeads & 2)) {
+			PROFILE_START(t1);
+			firBlock4(x, newKernel, newHeadTaps, head);
+			for (int k = 0; k < 4; ++k) wNew[k] += head[k];
+			PROFILE_ADD(p.phaseCycles[kProfileSecondPass], t1);
+		}
+		
+		for (int k = 0; k < 4; ++k) delay[wp + k] = dry[k];
+		wp = (wp + 4) & (lineSize - 1);
+		
+		if (kPass != kPassSingle) blendWet4<kPass>(p, w, wNew, j);
+	}
+	state->writePos = wp;
+}
+
+typedef void (*FftPassFn)(ChannelPass& p, FftChannel* fc, int fill, const float* in, float* wet, int numFrames);
+
+#define RAINBOW_FFT_PASS(...) template RAINBOW_HOT void fftPass<__VA_ARGS__>(ChannelPass&, FftChannel*, int, const float*, float*, int);
+RAINBOW_FFT_PASS(kPassSingle, 0)
+RAINBOW_FFT_PASS(kPassSingle, 1)
+RAINBOW_FFT_PASS(kPassCrossfade, 0)
+RAINBOW_FFT_PASS(kPassCrossfade, 1)
+RAINBOW_FFT_PASS(kPassCrossfade, 2)
+RAINBOW_FFT_PASS(kPassCrossfade, 3)
+RAINBOW_FFT_PASS(kPassMorph, 0)
+RAINBOW_FFT_PASS(kPassMorph, 3)
+#undef RAINBOW_FFT_PASS
+
+// By pass (the FFT output always plays; Dry only skips the head) and
+// heads. Morph slots share a size, so their heads go together.
+static const FftPassFn fftPasses[kNumPasses][4] = {
+	{ fftPass<kPassSingle, 0>, fftPass<kPassSingle, 0>, fftPass<kPassSingle, 0>, fftPass<kPassSingle, 0> },
+	{ fftPass<kPassSingle, 0>, fftPass<kPassSingle, 1>, fftPass<kPassSingle, 0>, fftPass<kPassSingle, 1> },
+	{ fftPass<kPassCrossfade, 0>, fftPass<kPassCrossfade, 1>, fftPass<kPassCrossfade, 2>, fftPass<kPassCrossfade, 3> },
+	{ fftPass<kPassMorph, 0>, fftPass<kPassMorph, 3>, fftPass<kPassMorph, 0>, fftPass<kPassMorph, 3> },
+};
+
+struct OutputMix {
+	float dryMix;
+	float depth;
+	const SaturationTable* curve;
+	float gain;
+};
+
+// Dry/wet mix, saturation and gain into the output bus, as mixSample().
+// The fixed Depth and unity gain cases give identical results without
+// the multiplies. dry and out may be the same bus.
+template <int kMix, bool kSaturate, bool kUnityGain, bool kReplace>
+RAINBOW_HOT static void outputStage(const float* dry, const float* __restrict wet, float* out, int numFrames,
+                                    const OutputMix& m) {
+	int i = 0;
+#ifdef RAINBOW_SIMD
+	for (; i + 4 <= numFrames; i += 4) {
+		Vec4 mixed = kMix == kMixWet ? v4load(wet + i)
+		           : kMix == kMixDry ? v4load(dry + i)
+		           : v4fma(v4load(dry + i), v4splat(m.dryMix), v4mul(v4load(wet + i), v4splat(m.depth)));
+		if (kSaturate) mixed = v4softSaturate(m.curve, mixed);
+		if (!kUnityGain) mixed = v4mul(mixed, v4splat(m.gain));
+		v4store(out + i, kReplace ? mixed : v4add(v4load(out + i), mixed));
+	}
+#endif
+	for (; i < numFrames; ++i) {
+		float mixed = kMix == kMixWet ? wet[i]
+		            : kMix == kMixDry ? dry[i]
+		            : fmaf(dry[i], m.dryMix, wet[i] * m.depth);
+		if (kSaturate) mixed = softSaturate(m.curve, mixed);
+		if (!kUnityGain) mixed *= m.gain;
+		if (kReplace) out[i] = mixed;
+		else out[i] += mixed;
+	}
+}
+
+typedef void (*OutputStageFn)(const float* dry, const float* wet, float* out, int numFrames, const OutputMix& m);
+
+#define RAINBOW_OUTPUT_STAGE(...) template RAINBOW_HOT void outputStage<__VA_ARGS__>(const float*, const float*, float*, int, const OutputMix&);
+#define RAINBOW_OUTPUT_STAGES(kMix) \
+	RAINBOW_OUTPUT_STAGE(kMix, false, false, false) RAINBOW_OUTPUT_STAGE(kMix, false, false, true) \
+	RAINBOW_OUTPUT_STAGE(kMix, false, true, false) RAINBOW_OUTPUT_STAGE(kMix, false, true, true) \
+	RAINBOW_OUTPUT_STAGE(kMix, true, false, false) RAINBOW_OUTPUT_STAGE(kMix, true, false, true) \
+	RAINBOW_OUTPUT_STAGE(kMix, true, true, false) RAINBOW_OUTPUT_STAGE(kMix, true, true, true)
+RAINBOW_OUTPUT_STAGES(kMixBlend)
+RAINBOW_OUTPUT_STAGES(kMixWet)
+RAINBOW_OUTPUT_STAGES(kMixDry)
+#undef RAINBOW_OUTPUT_STAGES
+#undef RAINBOW_OUTPUT_STAGE
+
+// By mix mode, saturation, unity gain and replace
+static const OutputStageFn outputStages[kNumMixModes][2][2][2] = {
+	{ { { outputStage<kMixBlend, false, false, false>, outputStage<kMixBlend, false, false, true> },
+	    { outputStage<kMixBlend, false, true, false>, outputStage<kMixBlend, false, true, true> } },
+	  { { outputStage<kMixBlend, true, false, false>, outputStage<kMixBlend, true, false, true> },
+	    { outputStage<kMixBlend, true, true, false>, outputStage<kMixBlend, true, true, true> } } },
+	{ { { outputStage<kMixWet, false, false, false>, outputStage<kMixWet, false, false, true> },
+	    { outputStage<kMixWet, false, true, false>, outputStage<kMixWet, false, true, true> } },
+	  { { outputStage<kMixWet, true, false, false>, outputStage<kMixWet, true, false, true> },
+	    { outputStage<kMixWet, true, true, false>, outputStage<kMixWet, true, true, true> } } },
+	{ { { outputStage<kMixDry, false, false, false>, outputStage<kMixDry, false, false, true> },
+	    { outputStage<kMixDry, false, true, false>, outputStage<kMixDry, false, true, true> } },
+	  { { outputStage<kMixDry, true, false, false>, outputStage<kMixDry, true, false, true> },
+	    { outputStage<kMixDry, true, true, false>, outputStage<kMixDry, true, true, true> } } },
 };
 
 // ============================================================================
-// HELPER FUNCTIONS
+// SHARED WAVETABLES
 // ============================================================================
 
-// Soft saturation using tanh approximation
-static inline float softSaturate(float x, float amount) {
-	if (amount < 0.001f) return x;
-	float drive = 1.0f + amount * 4.0f;  // 1x to 5x drive
-	return tanh(x * drive) / tanh(drive);
+// The firmware reads a whole mipmapped table at once. Instances take turns
+// with one buffer in static DRAM and copy the levels out into a shared
+// wave slot, where every instance selecting the same table finds them
+// without another read.
+static int16_t* loadBuffer = NULL;
+static std::atomic<_rainbowAlgorithm*> loadOwner(NULL);
+static WaveSlot waveSlots[kNumWaveSlots];
+static WaveSlot noWaves;                   // front slot before any load
+static std::atomic<uint32_t> waveClock(0);  // frames processed by all instances
+
+static void calculateStaticRequirements(_NT_staticRequirements& req) {
+	req.dram = (kWavetableBufferSize + kNumWaveSlots * waveLevelsSize(kMaxKernelSize)) * sizeof(int16_t);
 }
 
-static void buildKernelAtIndex(_rainbowAlgorithm* pThis, float* dest, float indexParam) {
-	_rainbow_DTC* dtc = pThis->dtc;
-	
-	indexParam = std::max(0.0f, std::min(1.0f, indexParam));
-	float offset = indexParam * (pThis->request.numWaves - 1);
-	offset = std::max(0.0f, std::min(offset, (float)(pThis->request.numWaves - 1) - 0.0001f));
-	
-	int wave0 = (int)offset;
-	int wave1 = std::min(wave0 + 1, (int)pThis->request.numWaves - 1);
-	float frac = offset - wave0;
-	
-	const int kernelSize = dtc->kernelSize;
-	
-	const int16_t* mip0 = pThis->wavetableBuffer + kernelSize * (pThis->request.numWaves + wave0);
-	const int16_t* mip1 = pThis->wavetableBuffer + kernelSize * (pThis->request.numWaves + wave1);
-	
-	float sum = 0.0f;
-	for (int i = 0; i < kernelSize; ++i) {
-		float v0 = mip0[i] / 32768.0f;
-		float v1 = mip1[i] / 32768.0f;
-		dest[i] = v0 + frac * (v1 - v0);
-		sum += fabsf(dest[i]);
+static void initialise(_NT_staticMemoryPtrs& ptrs, const _NT_staticRequirements& req) {
+	loadBuffer = (int16_t*)ptrs.dram;
+	for (int i = 0; i < kNumWaveSlots; ++i) {
+		WaveSlot* slot = &waveSlots[i];
+		slot->levels = loadBuffer + kWavetableBufferSize + i * waveLevelsSize(kMaxKernelSize);
+		slot->numWaves = 0;
+		slot->state.store(kSlotEmpty, std::memory_order_relaxed);
+		slot->generation.store(0, std::memory_order_relaxed);
+		slot->lastUse.store(0, std::memory_order_relaxed);
 	}
-	
-	if (sum > 0.001f) {
-		float scale = 1.0f / sum;
-		for (int i = 0; i < kernelSize; ++i) {
-			dest[i] *= scale;
-		}
+}
+
+static bool sameTable(const WaveSlot* slot, uint32_t index, const char* name) {
+	return slot->index == index && name && strncmp(slot->name, name, kWaveNameSize - 1) == 0;
+}
+
+// A ready slot holding the table, or NULL; generation is the one the
+// slot's contents were checked under
+static WaveSlot* findWaves(uint32_t index, const char* name, uint32_t& generation) {
+	for (int i = 0; i < kNumWaveSlots; ++i) {
+		WaveSlot* slot = &waveSlots[i];
+		generation = slot->generation.load(std::memory_order_acquire);
+		if (slot->state.load(std::memory_order_acquire) == kSlotReady && sameTable(slot, index, name)
+		    && slot->generation.load(std::memory_order_acquire) == generation)
+			return slot;
 	}
+	return NULL;
 }
 
-static void buildAllKernels(_rainbowAlgorithm* pThis, float kernels[][kMaxKernelSize]) {
-	float indexParam = pThis->v[kParamIndex] * 0.001f;
-	float spread = pThis->v[kParamSpread] * 0.001f;
-	int numChannels = pThis->numChannels;
-	int kernelSize = pThis->dtc->kernelSize;
-	
-	if (spread < 0.001f || numChannels == 1) {
-		buildKernelAtIndex(pThis, kernels[0], indexParam);
-		for (int ch = 1; ch < numChannels; ++ch) {
-			memcpy(kernels[ch], kernels[0], kernelSize * sizeof(float));
-		}
-	} else {
-		for (int ch = 0; ch < numChannels; ++ch) {
-			float chOffset = spread * ((float)ch / (numChannels - 1) - 0.5f);
-			buildKernelAtIndex(pThis, kernels[ch], indexParam + chOffset);
+// Take a slot to load into: an empty one, else the one whose lease ran
+// out longest ago. NULL while every slot is in use.
+static WaveSlot* claimWaves() {
+	const uint32_t now = waveClock.load(std::memory_order_relaxed);
+	WaveSlot* best = NULL;
+	int bestState = kSlotEmpty;
+	uint32_t bestAge = 0;
+	for (int i = 0; i < kNumWaveSlots; ++i) {
+		WaveSlot* slot = &waveSlots[i];
+		const int state = slot->state.load(std::memory_order_acquire);
+		const uint32_t age = state == kSlotEmpty ? ~0u : now - slot->lastUse.load(std::memory_order_relaxed);
+		if (state == kSlotLoading || age < kWaveLeaseFrames)
+			continue;
+		if (!best || age > bestAge) {
+			best = slot;
+			bestState = state;
+			bestAge = age;
 		}
 	}
-	
-	pThis->currentIndexParam = indexParam;
+	// Lost to another instance's claim: step() retries
+	if (!best || !best->state.compare_exchange_strong(bestState, kSlotLoading, std::memory_order_acquire))
+		return NULL;
+	best->generation.fetch_add(1, std::memory_order_acq_rel);
+	best->lastUse.store(now, std::memory_order_relaxed);
+	return best;
+}
+
+// Hand a slot to step(), which adopts it at the next block
+static void offerWaves(_rainbowAlgorithm* pThis, WaveSlot* slot, uint32_t generation) {
+	slot->lastUse.store(waveClock.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	pThis->offeredGeneration = generation;
+	pThis->offeredSlot.store(slot, std::memory_order_release);
 }
 
-static void updateKernel(_rainbowAlgorithm* pThis) {
-	if (!pThis->wavetableLoaded || pThis->request.error)
+// Request the selected wavetable, or leave it to step() to retry once
+// this instance's load completes, another instance frees the load buffer
+// or a wave slot comes free. The selection is read when the request is
+// made, so a quick scroll ends with one load of the latest wavetable. A
+// table already in a slot skips the read entirely.
+static void requestWavetable(_rainbowAlgorithm* pThis) {
+	pThis->loadWaiting = false;
+	pThis->slotWaiting = false;
+	if (!pThis->cardMounted)
 		return;
-	if (!pThis->request.usingMipMaps || pThis->request.numWaves == 0)
+	if (pThis->awaitingCallback) {
+		pThis->loadWaiting = true;
 		return;
+	}
 	
-	buildAllKernels(pThis, pThis->dtc->kernels);
-}
-
-static void updateKernelWithCrossfade(_rainbowAlgorithm* pThis) {
-	if (pThis->request.error)
+	const uint32_t index = pThis->v[kParamWavetable];
+	_NT_wavetableInfo info;
+	NT_getWavetableInfo(index, info);
+	uint32_t generation;
+	WaveSlot* slot = findWaves(index, info.name, generation);
+	if (slot) {
+		pThis->loadError = false;
+		offerWaves(pThis, slot, generation);
+		return;
+	}
+	
+	_rainbowAlgorithm* expected = NULL;
+	if (!loadOwner.compare_exchange_strong(expected, pThis, std::memory_order_acquire)) {
+		pThis->loadWaiting = true;
 		return;
-	if (!pThis->request.usingMipMaps || pThis->request.numWaves == 0)
+	}
+	slot = claimWaves();
+	if (!slot) {
+		loadOwner.store(NULL, std::memory_order_release);
+		pThis->loadWaiting = pThis->slotWaiting = true;
 		return;
+	}
+	slot->index = index;
+	strncpy(slot->name, info.name ? info.name : "", kWaveNameSize - 1);
+	slot->name[kWaveNameSize - 1] = 0;
+	pThis->loadSlot = slot;
+	pThis->request.index = index;
+	pThis->request.table = loadBuffer;
+	if (NT_readWavetable(pThis->request)) {
+		pThis->awaitingCallback = true;
+	} else {
+		slot->state.store(kSlotEmpty, std::memory_order_release);
+		loadOwner.store(NULL, std::memory_order_release);
+	}
+}
+
+// Copy the levels out of the load buffer (all of them: the slot serves
+// instances of any Max Resolution)
+static void extractWaveLevels(_rainbowAlgorithm* pThis, WaveSlot* slot) {
+	const int numWaves = pThis->request.numWaves;
+	for (int i = 0; i < kNumKernelSizes; ++i) {
+		const int size = kKernelSizes[i];
+		memcpy(slot->levels + kMaxWaves * (size - kKernelSizes[0]),
+		       loadBuffer + size * numWaves, size * numWaves * sizeof(int16_t));
+	}
+	slot->numWaves = numWaves;
+}
+
+// Consumer: at the block boundary, adopt an offered slot as the front
+// one, and renew the front slot's lease (or notice it was reused while
+// step() was not running, and load the table again)
+static void adoptWaves(_rainbowAlgorithm* pThis, int numFrames) {
+	waveClock.fetch_add(numFrames, std::memory_order_relaxed);
+	WaveSlot* slot = pThis->offeredSlot.exchange(NULL, std::memory_order_acquire);
+	if (slot == pThis->frontSlot.load(std::memory_order_relaxed) && pThis->offeredGeneration == pThis->frontGeneration) {
+		slot = NULL;  // already playing it
+	}
+	if (slot) {
+		if (slot == &noWaves || (slot->state.load(std::memory_order_acquire) == kSlotReady
+		                         && slot->generation.load(std::memory_order_acquire) == pThis->offeredGeneration)) {
+			pThis->cacheKernelSize.store(0, std::memory_order_release);  // rows are the old table's
+			pThis->frontSlot.store(slot, std::memory_order_release);
+			pThis->frontGeneration = pThis->offeredGeneration;
+			if (!pThis->wavetableLoaded) {
+				// The first table cuts in, even when a parameter set before it
+				// arrived asked for a crossfade
+				pThis->jobRequest.fetch_and(~kJobCrossfade, std::memory_order_relaxed);
+			}
+			requestKernels(pThis, kJobCache | kJobKernels | (pThis->wavetableLoaded ? kJobCrossfade : 0));
+			pThis->wavetableLoaded = true;
+		} else {
+			requestWavetable(pThis);
+		}
+	}
 	
-	_rainbow_DTC* dtc = pThis->dtc;
-	buildAllKernels(pThis, dtc->newKernels);
-	dtc->crossfadeMix = 0.0f;
-	dtc->crossfading = true;
+	WaveSlot* front = pThis->frontSlot.load(std::memory_order_relaxed);
+	if (front == &noWaves)
+		return;
+	if (front->state.load(std::memory_order_acquire) != kSlotReady
+	    || front->generation.load(std::memory_order_acquire) != pThis->frontGeneration) {
+		pThis->cacheKernelSize.store(0, std::memory_order_release);
+		pThis->frontSlot.store(&noWaves, std::memory_order_release);
+		requestKernels(pThis, kJobKernels);  // stops a job reading the old slot
+		requestWavetable(pThis);
+	} else if (!pThis->slotWaiting) {
+		front->lastUse.store(waveClock.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
 }
 
 // ============================================================================
 // FACTORY FUNCTIONS
 // ============================================================================
 
+static int numChannelsSpec(const int32_t* specifications) {
+	return specifications ? specifications[kSpecChannels] : 2;
+}
+
+// Largest kernel size within the Max Resolution specification
+static int maxSizeIndexSpec(const int32_t* specifications) {
+	const int maxTaps = specifications ? specifications[kSpecMaxResolution] : kMaxKernelSize;
+	int idx = 0;
+	while (idx < kNumKernelSizes - 1 && kKernelSizes[idx + 1] <= maxTaps) ++idx;
+	return idx;
+}
+
+// Longest chain within the Max Chain specification; chains need Max
+// Resolution at kMaxKernelSize
+static int maxChainIndexSpec(const int32_t* specifications) {
+	if (!specifications || kKernelSizes[maxSizeIndexSpec(specifications)] != kMaxKernelSize)
+		return 0;
+	int idx = 0;
+	while (idx < kNumChainSizes - 1 && kChainSizes[idx + 1] <= specifications[kSpecMaxChain]) ++idx;
+	return idx;
+}
+
+static int maxEngineSpec(const int32_t* specifications) {
+	return specifications ? specifications[kSpecMaxEngine] : kDirectHalfRate;
+}
+
+// Chain tail state of one channel (DRAM): spectra for every bank and a
+// delay line per stage, and the two rings
+static size_t chainChannelFloats(int maxChain) {
+	size_t floats = 2 * chainRingSize(maxChain);
+	for (int s = 0; s < kNumChainStages; ++s) {
+		floats += (kNumKernelBanks + 1) * chainPartitions(maxChain, s) * (kChainBlock[s] + 1) * 2;
+	}
+	return floats;
+}
+
+static size_t chainMemorySize(int numChannels, int maxChain) {
+	if (maxChain == 0)
+		return 0;
+	return sizeof(ChainEngine) + numChannels * (sizeof(ChainChannel) + chainChannelFloats(maxChain) * sizeof(float));
+}
+
+// Delay lines and kernel banks for a run of channels, with the Q15 copies
+// (from Max Engine Fixed) and half-band lines (Half rate) at the
+// direct-form sizes
+static size_t channelMemorySize(int numChannels, int maxKernelSize, int maxEngine) {
+	const int fixedSize = std::min(maxKernelSize, kMaxFixedKernelSize);
+	const size_t delayFloats = numChannels * maxKernelSize * 2;
+	const size_t kernelFloats = kNumKernelBanks * numChannels * maxKernelSize;
+	size_t halfRateFloats = 0;
+	size_t fixedSamples = 0;
+	if (maxEngine >= kDirectFixed) fixedSamples = numChannels * fixedSize * (2 + kNumKernelBanks);
+	if (maxEngine >= kDirectHalfRate) halfRateFloats = numChannels * (fixedSize * 2 + kNumKernelBanks * 2 * kHalfRateEndTaps);
+	return (delayFloats + kernelFloats + halfRateFloats) * sizeof(float) + fixedSamples * sizeof(int16_t);
+}
+
+// Point channels [first, first + count) at memory carved from mem; the
+// lines and copies Max Engine leaves out stay NULL
+static void carveChannels(_rainbow_DTC* dtc, uint8_t* mem, int first, int count, int maxKernelSize, int maxEngine) {
+	float* f = (float*)mem;
+	for (int ch = first; ch < first + count; ++ch) {
+		dtc->channels[ch].delayLine = f;
+		f += maxKernelSize * 2;
+	}
+	for (int b = 0; b < kNumKernelBanks; ++b) {
+		for (int ch = first; ch < first + count; ++ch) {
+			dtc->banks[b].kernels[ch] = f;
+			f += maxKernelSize;
+		}
+	}
+	
+	const int fixedSize = std::min(maxKernelSize, kMaxFixedKernelSize);
+	const bool halfRate = maxEngine >= kDirectHalfRate;
+	for (int ch = first; ch < first + count; ++ch) {
+		dtc->channels[ch].halfBandLine = halfRate ? f : NULL;
+		if (halfRate) f += fixedSize * 2;
+	}
+	for (int b = 0; b < kNumKernelBanks; ++b) {
+		for (int ch = first; ch < first + count; ++ch) {
+			dtc->banks[b].halfRateEnds[ch] = halfRate ? f : NULL;
+			if (halfRate) f += 2 * kHalfRateEndTaps;
+		}
+	}
+	
+	const bool fixed = maxEngine >= kDirectFixed;
+	int16_t* q = (int16_t*)f;
+	for (int ch = first; ch < first + count; ++ch) {
+		dtc->channels[ch].delayLineQ15 = fixed ? q : NULL;
+		if (fixed) q += fixedSize * 2;
+	}
+	for (int b = 0; b < kNumKernelBanks; ++b) {
+		for (int ch = first; ch < first + count; ++ch) {
+			dtc->banks[b].kernelsQ15[ch] = fixed ? q : NULL;
+			if (fixed) q += fixedSize;
+		}
+	}
+}
+
 static void calculateRequirements(_NT_algorithmRequirements& req, const int32_t* specifications) {
-	int numChannels = specifications ? specifications[kSpecChannels] : 2;
+	int numChannels = numChannelsSpec(specifications);
+	int maxKernelSize = kKernelSizes[maxSizeIndexSpec(specifications)];
+	int maxEngine = maxEngineSpec(specifications);
+	int dtcChannels = std::min(numChannels, kMaxDtcChannels);
 	int numParams = kNumSharedParams + numChannels * kParamsPerChannel;
 	
 	// Parameter storage
@@ -275,30 +3823,61 @@ static void calculateRequirements(_NT_algorithmRequirements& req, const int32_t*
 	size_t paramNameSize = numChannels * kParamsPerChannel * 16;  // "Output 12 Mode\0" etc
 	
 	req.numParameters = numParams;
-	req.sram = sizeof(_rainbowAlgorithm) + paramSize + pageSize + pageArraySize + paramNameSize;
-	req.dram = kWavetableBufferSize * sizeof(int16_t);
-	req.dtc = sizeof(_rainbow_DTC);
-	req.itc = 0;
+	// FFT engine state
+	size_t fftSize = sizeof(FftEngine) + numChannels * sizeof(FftChannel);
+	size_t sramChannelSize = channelMemorySize(numChannels - dtcChannels, maxKernelSize, maxEngine);
+	
+	// Copy of the hot stages (see placeHotCode()), in ITC or SRAM
+	size_t hotSize = 0;
+#ifdef RAINBOW_COPY_HOT_CODE
+	hotSize = hotCodeSize();
+#endif
+	const size_t sramHotSize = RAINBOW_PLACEMENT == RAINBOW_PLACE_SRAM ? hotSize : 0;
+	
+	req.sram = sizeof(_rainbowAlgorithm) + paramSize + pageSize + fftSize + sramChannelSize + pageArraySize + paramNameSize
+	         + sramHotSize;
+	req.dram = (kMaxCachedWaves * maxKernelSize + maxKernelSize * kMinPhaseOversample * 2) * sizeof(float)
+	         + numChannels * maxKernelSize * sizeof(int16_t)  // preset staging
+	         + chainMemorySize(numChannels, kChainSizes[maxChainIndexSpec(specifications)]);
+	req.dtc = sizeof(_rainbow_DTC) + channelMemorySize(dtcChannels, maxKernelSize, maxEngine);
+	req.itc = RAINBOW_PLACEMENT == RAINBOW_PLACE_ITC ? hotSize : 0;
 }
 
 static void wavetableCallback(void* callbackData) {
 	_rainbowAlgorithm* pThis = (_rainbowAlgorithm*)callbackData;
-	pThis->awaitingCallback = false;
+	pThis->loadError = pThis->request.error;
+	WaveSlot* slot = pThis->loadSlot;
 	
 	if (!pThis->request.error) {
-		if (pThis->wavetableLoaded) {
-			updateKernelWithCrossfade(pThis);
+		// Fill the claimed slot and offer it to step()
+		PROFILE_START(t);
+		if (pThis->request.usingMipMaps && pThis->request.numWaves <= (uint32_t)kMaxWaves) {
+			extractWaveLevels(pThis, slot);
+			slot->state.store(kSlotReady, std::memory_order_release);
+			offerWaves(pThis, slot, slot->generation.load(std::memory_order_relaxed));
 		} else {
-			pThis->wavetableLoaded = true;
-			buildAllKernels(pThis, pThis->dtc->kernels);
+			slot->state.store(kSlotEmpty, std::memory_order_release);
+			offerWaves(pThis, &noWaves, 0);
 		}
+		PROFILE_RECORD(pThis, kProfileWavetableLoad, t);
+	} else {
+		slot->state.store(kSlotEmpty, std::memory_order_release);
 	}
+	loadOwner.store(NULL, std::memory_order_release);
+	
+	// A selection made during the load is requested by the next step()
+	pThis->awaitingCallback = false;
 }
 
 static _NT_algorithm* construct(const _NT_algorithmMemoryPtrs& ptrs,
                                 const _NT_algorithmRequirements& req,
                                 const int32_t* specifications) {
-	int numChannels = specifications ? specifications[kSpecChannels] : 2;
+	int numChannels = numChannelsSpec(specifications);
+	int maxSizeIndex = maxSizeIndexSpec(specifications);
+	int maxKernelSize = kKernelSizes[maxSizeIndex];
+	int maxChainIndex = maxChainIndexSpec(specifications);
+	int maxEngine = maxEngineSpec(specifications);
+	int dtcChannels = std::min(numChannels, kMaxDtcChannels);
 	int numParams = kNumSharedParams + numChannels * kParamsPerChannel;
 	int numPages = 3;
 	
@@ -316,6 +3895,16 @@ static _NT_algorithm* construct(const _NT_algorithmMemoryPtrs& ptrs,
 	mem += numPages * sizeof(_NT_parameterPage);
 	alg->numPages = numPages;
 	
+	// Allocate FFT engine state
+	alg->fft = (FftEngine*)mem;
+	mem += sizeof(FftEngine);
+	alg->fftChannels = (FftChannel*)mem;
+	mem += numChannels * sizeof(FftChannel);
+	
+	// Delay lines and kernels of the channels beyond DTC (carved below)
+	uint8_t* sramChannels = mem;
+	mem += channelMemorySize(numChannels - dtcChannels, maxKernelSize, maxEngine);
+	
 	// Allocate page array for routing page
 	alg->pageArrays = mem;
 	mem += numChannels * kParamsPerChannel * sizeof(uint8_t);
@@ -324,8 +3913,13 @@ static _NT_algorithm* construct(const _NT_algorithmMemoryPtrs& ptrs,
 	alg->paramNames = (char*)mem;
 	mem += numChannels * kParamsPerChannel * 16;
 	
+	// SRAM placement of the hot stages
+	uint8_t* hotSram = mem;
+	
 	// Copy shared parameters
 	memcpy(alg->params, sharedParameters, sizeof(sharedParameters));
+	alg->params[kParamChain].max = maxChainIndex;
+	alg->params[kParamEngine].max = maxEngine;
 	
 	// Generate per-channel parameters with numbered names
 	for (int ch = 0; ch < numChannels; ++ch) {
@@ -336,7 +3930,7 @@ static _NT_algorithm* construct(const _NT_algorithmMemoryPtrs& ptrs,
 		
 		// Adjust default bus assignments
 		alg->params[baseParam + kParamInput].def = 1 + ch;
-		alg->params[baseParam + kParamOutput].def = 13 + ch;
+		alg->params[baseParam + kParamOutput].def = std::min(13 + ch, kNumBusses);
 		
 		// Build parameter names: "Input 1", "Output 1", "Out 1 Mode"
 		for (int p = 0; p < kParamsPerChannel; ++p) {
@@ -383,24 +3977,102 @@ static _NT_algorithm* construct(const _NT_algorithmMemoryPtrs& ptrs,
 	alg->parameters = alg->params;
 	alg->parameterPages = &alg->paramPages;
 	
-	// Set up DTC
-	alg->dtc = (_rainbow_DTC*)ptrs.dtc;
-	memset(alg->dtc, 0, sizeof(_rainbow_DTC));
+	// Set up DTC: state, then the delay lines and kernel banks of the
+	// first kMaxDtcChannels; any others are in SRAM
+	memset(ptrs.dtc, 0, req.dtc);
+	alg->dtc = new (ptrs.dtc) _rainbow_DTC;
+	carveChannels(alg->dtc, ptrs.dtc + sizeof(_rainbow_DTC), 0, dtcChannels, maxKernelSize, maxEngine);
+	memset(sramChannels, 0, channelMemorySize(numChannels - dtcChannels, maxKernelSize, maxEngine));
+	carveChannels(alg->dtc, sramChannels, dtcChannels, numChannels - dtcChannels, maxKernelSize, maxEngine);
+	
+	// Run the hot stages from their copy (in place otherwise, at offset 0)
+#ifdef RAINBOW_COPY_HOT_CODE
+	alg->dtc->hotOffset = placeHotCode(RAINBOW_PLACEMENT == RAINBOW_PLACE_ITC ? ptrs.itc : hotSram);
+#else
+	(void)hotSram;
+#endif
+	
+	// Set up the kernel cache, minimum-phase scratch and preset staging;
+	// the waves are in the shared slots
+	memset(ptrs.dram, 0, req.dram);
+	alg->loadSlot = NULL;
+	alg->offeredSlot.store(NULL, std::memory_order_relaxed);
+	alg->offeredGeneration = 0;
+	alg->frontSlot.store(&noWaves, std::memory_order_relaxed);
+	alg->frontGeneration = 0;
+	alg->loadError = false;
+	alg->kernelCache = (float*)ptrs.dram;
+	alg->phaseWork = alg->kernelCache + kMaxCachedWaves * maxKernelSize;
+	alg->preset.taps = (int16_t*)(alg->phaseWork + maxKernelSize * kMinPhaseOversample * 2);
+	alg->preset.state.store(kPresetEmpty, std::memory_order_relaxed);
+	
+	// Chain tail state, after the staging area
+	const int maxChain = kChainSizes[maxChainIndex];
+	alg->chain = NULL;
+	alg->chainChannels = NULL;
+	if (maxChain) {
+		// Channels first: their pointers need the 8 byte alignment the staging area ends on
+		alg->chainChannels = (ChainChannel*)(alg->preset.taps + numChannels * maxKernelSize);
+		ChainEngine* c = alg->chain = (ChainEngine*)(alg->chainChannels + numChannels);
+		float* f = (float*)(c + 1);
+		for (int s = 0; s < kNumChainStages; ++s) {
+			c->partitions[s] = chainPartitions(maxChain, s);
+		}
+		c->ringMask = chainRingSize(maxChain) - 1;
+		for (int ch = 0; ch < numChannels; ++ch) {
+			ChainChannel* cc = &alg->chainChannels[ch];
+			for (int s = 0; s < kNumChainStages; ++s) {
+				const int stageFloats = c->partitions[s] * (kChainBlock[s] + 1) * 2;
+				for (int b = 0; b < kNumKernelBanks; ++b) {
+					cc->spectra[s][b] = f;
+					f += stageFloats;
+				}
+				cc->fdl[s] = f;
+				f += stageFloats;
+			}
+			cc->input = f;
+			f += chainRingSize(maxChain);
+			cc->output = f;
+			f += chainRingSize(maxChain);
+		}
+		initFftTables(&c->tables0);
+		initFftTables(&c->tables1);
+	}
+	alg->cacheKernelSize.store(0, std::memory_order_relaxed);
+	alg->cacheNumWaves = 0;
+	alg->cacheStamp = 0;
+	alg->jobRequest.store(0, std::memory_order_relaxed);
+	alg->job.flags = 0;
+	alg->job.stage = kStageIdle;
+	alg->job.bank = -1;
+	alg->job.published = -1;
+	alg->responseFront.store(-1, std::memory_order_relaxed);
+	alg->display.slot = NULL;
+	alg->display.wavetable = -1;
 	
-	// Set up wavetable buffer
-	alg->wavetableBuffer = (int16_t*)ptrs.dram;
-	memset(alg->wavetableBuffer, 0, req.dram);
+	// Set up FFT engine
+	initFftTables(alg->fft);
+	resetFft(alg->fft, alg->fftChannels, numChannels);
+	alg->fft->headPartitions = 0;
+	for (int ch = 0; ch < numChannels; ++ch) {
+		alg->fftChannels[ch].idle = false;
+	}
 	
 	// Initialize wavetable request
-	alg->request.table = alg->wavetableBuffer;
+	alg->request.table = loadBuffer;
 	alg->request.tableSize = kWavetableBufferSize;
 	alg->request.callback = wavetableCallback;
 	alg->request.callbackData = alg;
 	
 	// Initialize state
 	alg->numChannels = numChannels;
+	alg->maxSizeIndex = maxSizeIndex;
+	alg->maxChainIndex = maxChainIndex;
+	alg->maxEngine = maxEngine;
 	alg->cardMounted = false;
 	alg->awaitingCallback = false;
+	alg->loadWaiting = false;
+	alg->slotWaiting = false;
 	alg->wavetableLoaded = false;
 	alg->currentWaveIndex = -1;
 	alg->currentIndexParam = -1.0f;
@@ -409,8 +4081,35 @@ static _NT_algorithm* construct(const _NT_algorithmMemoryPtrs& ptrs,
 	alg->dtc->depth = 0.5f;
 	alg->dtc->gain = 1.0f;
 	alg->dtc->saturation = 0.0f;
-	alg->dtc->kernelSize = kKernelSizes[2];  // Default: 256
-	alg->dtc->kernelMask = alg->dtc->kernelSize - 1;
+	buildSaturationTable(&alg->dtc->saturationTables[0], kCurveTanh, 0.0f);
+	alg->dtc->saturationFront = 0;
+	alg->dtc->saturationMiddle.store(1, std::memory_order_relaxed);
+	alg->dtc->saturationBack = 2;
+	const int defaultSizeIndex = std::min(2, maxSizeIndex);  // Default: 256
+	alg->kernelSize = kKernelSizes[defaultSizeIndex];
+	alg->dtc->kernelSize = alg->kernelSize;
+	alg->dtc->lineSize = kKernelSizes[maxSizeIndex];
+	
+	// Bank 0 starts out as the (silent) front bank
+	for (int b = 0; b < kNumKernelBanks; ++b) {
+		alg->dtc->bankState[b].store(kBankFree, std::memory_order_relaxed);
+		alg->dtc->banks[b].kernelSize = alg->kernelSize;
+	}
+	alg->dtc->bankState[0].store(kBankFront, std::memory_order_relaxed);
+	alg->dtc->frontBank = 0;
+	alg->dtc->fadeBank = -1;
+	alg->dtc->nextBank = -1;
+	alg->dtc->warmBlocks = -1;
+	if (alg->chain) releaseChain(alg->chain, alg->dtc, numChannels);
+	
+	// Auto starts from the default size
+	alg->dtc->autoSize.store(defaultSizeIndex, std::memory_order_relaxed);
+	for (int i = 0; i < kNumKernelSizes; ++i) {
+		alg->dtc->backoff[i] = kGovernorBackoffSeconds;
+	}
+	alg->dtc->holdUntil = kGovernorHoldSeconds * NT_globals.sampleRate;  // let the average settle first
+	enableCycleCounter();
+	invalidateMorph(alg);
 	
 	return alg;
 }
@@ -432,23 +4131,33 @@ static int parameterString(_NT_algorithm* self, int p, int v, char* buff) {
 	return 0;
 }
 
+// Kernel size for new sets: Resolution (in Auto, the governor's size)
+// within Max Resolution, or the full size for a chain's head
+static void updateKernelSize(_rainbowAlgorithm* pThis) {
+	int idx = pThis->v[kParamKernelSize];
+	if (idx == kAutoResolution) {
+		idx = pThis->dtc->autoSize.load(std::memory_order_relaxed);
+	}
+	idx = std::max(0, std::min(idx, pThis->maxSizeIndex));
+	if (chainLength(pThis) > 0) {
+		idx = pThis->maxSizeIndex;  // kMaxKernelSize, see maxChainIndexSpec
+	}
+	pThis->kernelSize = kKernelSizes[idx];
+}
+
 static void parameterChanged(_NT_algorithm* self, int p) {
 	_rainbowAlgorithm* pThis = (_rainbowAlgorithm*)self;
 	_rainbow_DTC* dtc = pThis->dtc;
 	
 	switch (p) {
 	case kParamWavetable:
-		if (!pThis->awaitingCallback && pThis->cardMounted) {
-			pThis->request.index = pThis->v[kParamWavetable];
-			if (NT_readWavetable(pThis->request)) {
-				pThis->awaitingCallback = true;
-			}
-		}
+		requestWavetable(pThis);
 		break;
 		
 	case kParamIndex:
 	case kParamSpread:
-		updateKernel(pThis);
+		// In morph mode step() follows Index and Spread without a rebuild
+		if (!dtc->morph) requestKernels(pThis, kJobKernels);
 		break;
 		
 	case kParamDepth:
@@ -463,15 +4172,53 @@ static void parameterChanged(_NT_algorithm* self, int p) {
 		break;
 		
 	case kParamSaturation:
-		dtc->saturation = pThis->v[kParamSaturation] / 100.0f;
+	case kParamSaturationCurve:
+		{
+			dtc->saturation = pThis->v[kParamSaturation] / 100.0f;
+			const int back = dtc->saturationBack;
+			buildSaturationTable(&dtc->saturationTables[back], pThis->v[kParamSaturationCurve], dtc->saturation);
+			dtc->saturationBack = dtc->saturationMiddle.exchange(back | kSaturationFresh, std::memory_order_acq_rel)
+			                    & ~kSaturationFresh;
+		}
 		break;
 		
 	case kParamKernelSize:
-		{
-			int idx = std::max(0, std::min((int)pThis->v[kParamKernelSize], kNumKernelSizes - 1));
-			dtc->kernelSize = kKernelSizes[idx];
-			dtc->kernelMask = dtc->kernelSize - 1;
-			updateKernel(pThis);
+		// step() adopts the new size along with the kernels built for it
+		updateKernelSize(pThis);
+		requestKernels(pThis, kJobKernels);
+		break;
+		
+	case kParamChain:
+		updateKernelSize(pThis);
+		if (!dtc->morph) requestKernels(pThis, kJobKernels | kJobCrossfade);
+		break;
+		
+	case kParamPhase:
+		requestKernels(pThis, kJobCache | kJobKernels | kJobCrossfade);
+		break;
+		
+	case kParamEnergy:
+		requestKernels(pThis, kJobMeasure | kJobKernels | kJobCrossfade);
+		break;
+		
+	case kParamLatency:
+		dtc->zeroLatency = pThis->v[kParamLatency] == 0;
+		break;
+		
+	case kParamEngine:
+		dtc->fixedPoint = directEngine(pThis) == kDirectFixed;
+		// Half rate changes the float kernels themselves: rebuild them and
+		// crossfade (slots keyed for the other setting are rebuilt)
+		requestKernels(pThis, kJobKernels | kJobCrossfade);
+		break;
+		
+	case kParamMorph:
+		dtc->morph = pThis->v[kParamMorph];
+		updateKernelSize(pThis);  // chains are off while morphing
+		if (dtc->morph) {
+			dtc->morphGeneration.fetch_add(1, std::memory_order_release);
+		} else {
+			requestKernels(pThis, kJobKernels);
 		}
 		break;
 	}
@@ -490,116 +4237,272 @@ static void step(_NT_algorithm* self, float* busFrames, int numFramesBy4) {
 			parameterChanged(self, kParamWavetable);
 		}
 	}
+	if (pThis->loadWaiting) {
+		requestWavetable(pThis);
+	}
+	adoptWaves(pThis, numFramesBy4 << 2);
+	takeKernelRequests(pThis);
 	
+	const uint32_t startCycles = readCycleCounter();
 	const int numFrames = numFramesBy4 << 2;
 	const float depth = dtc->depth;
 	const float dryMix = 1.0f - depth;
 	const float gain = dtc->gain;
-	const float saturation = dtc->saturation;
 	const bool doConvolve = pThis->wavetableLoaded;
-	const bool doSaturate = saturation > 0.001f;
+	if (dtc->saturationMiddle.load(std::memory_order_relaxed) & kSaturationFresh) {
+		dtc->saturationFront = dtc->saturationMiddle.exchange(dtc->saturationFront, std::memory_order_acq_rel)
+		                     & ~kSaturationFresh;
+	}
+	const SaturationTable* curve = dtc->saturation > 0.001f ? &dtc->saturationTables[dtc->saturationFront] : NULL;
+	const intptr_t hotOffset = dtc->hotOffset;
+#ifdef RAINBOW_PROFILE
+	uint32_t phaseCycles[kNumProfileStats] = {};
+#endif
+	
+	// Kernel handoff happens here, at the block boundary. Audio-rate
+	// morph keeps both banks permanently and blends them per sample.
+	const int morphCvBus = pThis->v[kParamMorphCv];
+	const float* cv = morphCvBus ? busFrames + (morphCvBus - 1) * numFrames : NULL;
+	bool morphing = doConvolve && dtc->morph;
+	if (morphing) {
+		if (pThis->chain) releaseChain(pThis->chain, dtc, pThis->numChannels);  // morph slots take both banks
+		cancelSizeChange(dtc);
+	}
+	if (morphing) {
+		morphing = updateMorphKernels(pThis, cv ? cv[0] * kMorphCvScale : 0.0f, numFrames);
+	} else if (!dtc->crossfading) {
+		releaseFadeBank(dtc);
+	}
+	if (!morphing) {
+		pickUpKernels(pThis);
+	}
+	PROFILE_ADD(phaseCycles[kProfileHandoff], startCycles);
+	const bool morphSnap = dtc->morphSnap;
+	dtc->morphSnap = false;
+	
 	const int kernelSize = dtc->kernelSize;
-	const int kernelMask = dtc->kernelMask;
+	const bool useFft = useFftEngine(kernelSize);
+	const bool fixedPoint = dtc->fixedPoint && !useFft;
 	
-	bool crossfading = dtc->crossfading;
-	float crossfadeMix = dtc->crossfadeMix;
+	const bool crossfading = dtc->crossfading;
 	constexpr float kCrossfadeRate = 1.0f / 2400.0f;  // ~50ms at 48kHz
 	
-	for (int ch = 0; ch < pThis->numChannels; ++ch) {
-		const int baseParam = kNumSharedParams + ch * kParamsPerChannel;
-		const float* __restrict in = busFrames + (pThis->v[baseParam + kParamInput] - 1) * numFrames;
-		float* __restrict out = busFrames + (pThis->v[baseParam + kParamOutput] - 1) * numFrames;
-		const bool replace = pThis->v[baseParam + kParamOutputMode];
-		ChannelState* state = &dtc->channels[ch];
-		float* __restrict delay = state->delayLine;
-		int wp = state->writePos;
+	// Bank A is played alone; bank B is blended in while crossfading
+	// (A = old, B = new) or morphing (A = even wave, B = odd wave)
+	const bool dualBank = crossfading || morphing;
+	const int bankIndexA = crossfading ? dtc->fadeBank : dtc->frontBank;
+	const int bankIndexB = !dualBank ? -1 : crossfading ? dtc->frontBank : dtc->fadeBank;
+	const KernelBank* bankA = &dtc->banks[bankIndexA];
+	const KernelBank* bankB = dualBank ? &dtc->banks[bankIndexB] : bankA;
+	
+	// The output stage is picked once for the block and the wet stage once
+	// per channel. Depth at 0% leaves the convolution out unless a blend
+	// has to keep advancing. During a crossfade, channels whose kernel did
+	// not change play bank A alone: it holds the same kernel as bank B.
+	const int mixMode = depth == 1.0f ? kMixWet : depth == 0.0f ? kMixDry : kMixBlend;
+	const int pass = !doConvolve || (mixMode == kMixDry && !dualBank) ? kPassDry
+	               : morphing ? kPassMorph : crossfading ? kPassCrossfade : kPassSingle;
+	const int steadyPass = !doConvolve || mixMode == kMixDry ? kPassDry : kPassSingle;
+	const OutputMix outputMix = { dryMix, depth, curve, gain };
+	const int saturate = curve != NULL;
+	const int unityGain = gain == 1.0f;
+	
+	if (doConvolve && useFft) {
+		// Channels advance one segment at a time so that every channel
+		// reaches the FFT block boundary together.
+		FftEngine* fft = pThis->fft;
+		const bool shared = bankA->shared;
 		
-		const float* __restrict kernel = dtc->kernels[ch];
-		const float* __restrict newKernel = dtc->newKernels[ch];
-		float localMix = crossfadeMix;
+		// The tail lasts the kernel (or a chain still convolving) plus up to
+		// two blocks in the FFT pipeline
+		const int chainTaps = std::max(dtc->banks[dtc->frontBank].chainTaps,
+		                               dtc->fadeBank >= 0 ? dtc->banks[dtc->fadeBank].chainTaps : 0);
+		const int tail = std::max(kernelSize, chainTaps) + 2 * kFftBlockSize;
+		bool idle[kMaxChannels];
+		int channelPass[kMaxChannels];
+		for (int ch = 0; ch < pThis->numChannels; ++ch) {
+			const float* in = busFrames + (pThis->v[kNumSharedParams + ch * kParamsPerChannel + kParamInput] - 1) * numFrames;
+			idle[ch] = updateIdle(pThis, ch, in, numFrames, tail);
+			const bool fading = dtc->channels[ch].crossfading;
+			channelPass[ch] = pass == kPassCrossfade && !fading ? steadyPass : pass;
+			pThis->fftChannels[ch].secondPass = morphing || (crossfading && fading);
+		}
 		
-		for (int i = 0; i < numFrames; ++i) {
-			const float dry = in[i];
-			delay[wp] = dry;
-			delay[wp + kernelSize] = dry;
+		for (int i = 0; i < numFrames; ) {
+			const int fill = fft->fill;
+			const int n = std::min(numFrames - i, kFftBlockSize - fill);
+			const int heads = bankHead(fft, bankA) | bankHead(fft, bankB) << 1;
 			
-			float wet;
-			if (doConvolve) {
-				const float* __restrict x = &delay[wp + kernelSize];
-				const float* __restrict h = kernel;
-				float a0 = 0.0f, a1 = 0.0f, a2 = 0.0f, a3 = 0.0f;
-				
-				for (int k = 0; k < kernelSize; k += 4) {
-					a0 = fmaf(x[0], h[k], a0);
-					a1 = fmaf(x[-1], h[k + 1], a1);
-					a2 = fmaf(x[-2], h[k + 2], a2);
-					a3 = fmaf(x[-3], h[k + 3], a3);
-					x -= 4;
+			for (int ch = 0; ch < pThis->numChannels; ++ch) {
+				const int baseParam = kNumSharedParams + ch * kParamsPerChannel;
+				const float* in = busFrames + (pThis->v[baseParam + kParamInput] - 1) * numFrames + i;
+				float* out = busFrames + (pThis->v[baseParam + kParamOutput] - 1) * numFrames + i;
+				const bool replace = pThis->v[baseParam + kParamOutputMode];
+				ChannelState* state = &dtc->channels[ch];
+				const bool ramp = channelPass[ch] == kPassCrossfade;
+				if (idle[ch]) {
+					mixIdle(in, out, n, replace, dryMix, curve, gain);
+					// The crossfade still ramps per sample, keeping its schedule exact
+					if (ramp) {
+						for (int j = 0; j < n; ++j) state->crossfadeMix += kCrossfadeRate;
+					}
+					continue;
 				}
-				float wetOld = (a0 + a1) + (a2 + a3);
 				
-				if (crossfading) {
-					x = &delay[wp + kernelSize];
-					h = newKernel;
-					a0 = 0.0f; a1 = 0.0f; a2 = 0.0f; a3 = 0.0f;
-					for (int k = 0; k < kernelSize; k += 4) {
-						a0 = fmaf(x[0], h[k], a0);
-						a1 = fmaf(x[-1], h[k + 1], a1);
-						a2 = fmaf(x[-2], h[k + 2], a2);
-						a3 = fmaf(x[-3], h[k + 3], a3);
-						x -= 4;
-					}
-					float wetNew = (a0 + a1) + (a2 + a3);
-					wet = wetOld + (wetNew - wetOld) * localMix;
-					if (ch == 0) localMix += kCrossfadeRate;
-				} else {
-					wet = wetOld;
+				ChannelPass p;
+				const float target = channelIndex(pThis, ch);
+				beginPass(p, pThis, ch, bankA, bankB, state->crossfadeMix, ramp ? kCrossfadeRate : 0.0f,
+				          morphSnap ? target : dtc->morphIndex[ch], i, numFrames);
+				p.cv = cv ? cv + i : NULL;
+#ifdef RAINBOW_PROFILE
+				p.phaseCycles = phaseCycles;
+#endif
+				
+				float wet[kFftBlockSize];
+				placed(fftPasses[channelPass[ch]][heads], hotOffset)(p, &pThis->fftChannels[ch], fill, in, wet, n);
+				if (ramp) state->crossfadeMix = p.mix;
+				
+				PROFILE_START(t2);
+				placed(outputStages[mixMode][saturate][unityGain][replace], hotOffset)(in, wet, out, n, outputMix);
+				PROFILE_ADD(phaseCycles[kProfileMix], t2);
+			}
+			
+			i += n;
+			fft->fill = fill + n;
+			if (fft->fill == kFftBlockSize) {
+				// The latency mode changes only between output blocks
+				fft->headPartitions = dtc->zeroLatency ? 1 : 0;
+				PROFILE_START(t);
+				fftProcessBlock(fft, pThis->fftChannels, pThis->numChannels,
+				                bankIndexA, shared, bankPartitions(bankA), bankHead(fft, bankA),
+				                bankIndexB, bankB->shared, bankPartitions(bankB), bankHead(fft, bankB), hotOffset);
+				if (pThis->chain) {
+					chainProcessBlock(pThis->chain, pThis->chainChannels, pThis->fftChannels, dtc,
+					                  pThis->numChannels, fft->headPartitions ? 0 : kFftBlockSize);
 				}
-			} else {
-				wet = dry;
+				PROFILE_ADD(phaseCycles[kProfileConvolve], t);
+#ifdef RAINBOW_PROFILE
+				phaseCycles[kProfileConvolve] -= fft->secondPassCycles;
+				phaseCycles[kProfileSecondPass] += fft->secondPassCycles;
+#endif
+				fft->fill = 0;
+			}
+		}
+		if (morphing) {
+			for (int ch = 0; ch < pThis->numChannels; ++ch) {
+				dtc->morphIndex[ch] = channelIndex(pThis, ch);
+			}
+		}
+	} else {
+		const int q15 = useFft ? kQ15None : fixedPoint ? kQ15Engine : kQ15Shadow;
+		
+		for (int ch = 0; ch < pThis->numChannels; ++ch) {
+			const int baseParam = kNumSharedParams + ch * kParamsPerChannel;
+			const float* in = busFrames + (pThis->v[baseParam + kParamInput] - 1) * numFrames;
+			float* out = busFrames + (pThis->v[baseParam + kParamOutput] - 1) * numFrames;
+			const bool replace = pThis->v[baseParam + kParamOutputMode];
+			ChannelState* state = &dtc->channels[ch];
+			const int channelPass = pass == kPassCrossfade && !state->crossfading ? steadyPass : pass;
+			const bool ramp = channelPass == kPassCrossfade;
+			if (doConvolve && updateIdle(pThis, ch, in, numFrames, kernelSize)) {
+				mixIdle(in, out, numFrames, replace, dryMix, curve, gain);
+				if (ramp) {
+					for (int i = 0; i < numFrames; ++i) state->crossfadeMix += kCrossfadeRate;
+				}
+				if (morphing) dtc->morphIndex[ch] = channelIndex(pThis, ch);
+				continue;
 			}
+			if (dtc->warmBlocks >= 0) feedFftInput(pThis->fft, &pThis->fftChannels[ch], in, numFrames);
 			
-			wp = (wp + 1) & kernelMask;
+			ChannelPass p;
+			const float target = channelIndex(pThis, ch);
+			beginPass(p, pThis, ch, bankA, bankB, state->crossfadeMix, ramp ? kCrossfadeRate : 0.0f,
+			          morphSnap ? target : dtc->morphIndex[ch], 0, numFrames);
+#ifdef RAINBOW_PROFILE
+			p.phaseCycles = phaseCycles;
+#endif
+			if (morphing) dtc->morphIndex[ch] = target;
+			const DirectPassFn channelStage = placed(channelPass == kPassSingle && q15 == kQ15Shadow
+				? formPasses[bankA->form[p.slotA]] : directPasses[channelPass][q15], hotOffset);
+			const OutputStageFn outputStage = placed(outputStages[mixMode][saturate][unityGain][replace], hotOffset);
 			
-			float mixed = fmaf(dry, dryMix, wet * depth);
-			if (doSaturate) mixed = softSaturate(mixed, saturation);
-			mixed *= gain;
+			// Wet samples go through a stack buffer, a block at a time
+			for (int i = 0; i < numFrames; i += kFftBlockSize) {
+				const int n = std::min(numFrames - i, kFftBlockSize);
+				float wet[kFftBlockSize];
+				p.cv = cv ? cv + i : NULL;
+				channelStage(p, in + i, wet, n);
+				
+				PROFILE_START(t2);
+				outputStage(in + i, wet, out + i, n, outputMix);
+				PROFILE_ADD(phaseCycles[kProfileMix], t2);
+			}
 			
-			if (replace) out[i] = mixed;
-			else out[i] += mixed;
-		}
-		state->writePos = wp;
-		
-		if (ch == 0 && crossfading) {
-			crossfadeMix = localMix;
+			if (ramp) state->crossfadeMix = p.mix;
 		}
+		if (dtc->warmBlocks >= 0) advanceFftFeed(pThis, numFrames);
 	}
 	
 	if (crossfading) {
-		if (crossfadeMix >= 1.0f) {
-			for (int ch = 0; ch < pThis->numChannels; ++ch) {
-				for (int i = 0; i < kernelSize; ++i) {
-					dtc->kernels[ch][i] = dtc->newKernels[ch][i];
-				}
+		// Channels finish on their own; the fade bank is released with the
+		// last. In the FFT engine the front bank also takes over the rest
+		// of the current output block.
+		PROFILE_START(t);
+		bool stillFading = false;
+		for (int ch = 0; ch < pThis->numChannels; ++ch) {
+			ChannelState* state = &dtc->channels[ch];
+			if (!state->crossfading)
+				continue;
+			if (state->crossfadeMix < 1.0f) {
+				stillFading = true;
+				continue;
+			}
+			state->crossfading = false;
+			FftChannel* fc = &pThis->fftChannels[ch];
+			if (useFft && fc->newValid) {
+				memcpy(fc->output, fc->outputNew, sizeof(fc->output));
+				fc->newValid = false;
 			}
-			dtc->crossfading = false;
-			dtc->crossfadeMix = 0.0f;
-		} else {
-			dtc->crossfadeMix = crossfadeMix;
 		}
+		if (!stillFading) releaseFadeBank(dtc);
+		PROFILE_ADD(phaseCycles[kProfileHandoff], t);
+	}
+	
+	const uint32_t cycles = readCycleCounter() - startCycles;
+#ifdef RAINBOW_PROFILE
+	phaseCycles[kProfileStep] = cycles;
+	for (int i = kProfileStep; i <= kProfileHandoff; ++i) {
+		profileRecord(&pThis->profile[i], (float)phaseCycles[i] / numFrames);
 	}
+#endif
+	runGovernor(pThis, cycles, numFrames);
+	runKernelJob(pThis, numFrames);
 }
 
 static bool draw(_NT_algorithm* self) {
 	_rainbowAlgorithm* pThis = (_rainbowAlgorithm*)self;
+	DisplayCache* display = &pThis->display;
 	
-	// Draw wavetable name
-	int index = pThis->v[kParamWavetable];
-	_NT_wavetableInfo info;
-	NT_getWavetableInfo(index, info);
+	// Look the name up again only when the selection or the table changes
+	const WaveSlot* slot = frontWaves(pThis);
+	const uint32_t generation = pThis->frontGeneration;
+	const int wavetable = pThis->v[kParamWavetable];
+	const bool tableChanged = slot != display->slot || generation != display->generation;
+	if (wavetable != display->wavetable || tableChanged || pThis->cardMounted != display->cardMounted) {
+		_NT_wavetableInfo info;
+		NT_getWavetableInfo(wavetable, info);
+		display->hasName = info.name != NULL;
+		if (info.name) {
+			strncpy(display->name, info.name, kWaveNameSize - 1);
+			display->name[kWaveNameSize - 1] = 0;
+		}
+		display->wavetable = wavetable;
+		display->cardMounted = pThis->cardMounted;
+	}
 	
-	if (info.name) {
-		NT_drawText(10, 20, info.name, 15, kNT_textLeft, kNT_textNormal);
+	// Draw wavetable name
+	if (display->hasName) {
+		NT_drawText(10, 20, display->name, 15, kNT_textLeft, kNT_textNormal);
 	} else {
 		NT_drawText(10, 20, "No wavetable", 8, kNT_textLeft, kNT_textNormal);
 	}
@@ -607,32 +4510,41 @@ static bool draw(_NT_algorithm* self) {
 	// Draw status
 	if (pThis->awaitingCallback) {
 		NT_drawText(10, 35, "Loading...", 8);
-	} else if (pThis->request.error) {
+	} else if (pThis->loadError) {
 		NT_drawText(10, 35, "Error", 8);
 	}
 	
-	// Draw waveform if wavetable loaded and using mipmaps
-	if (pThis->wavetableLoaded && pThis->request.usingMipMaps && pThis->request.numWaves > 0) {
-		// Get current wave position
-		float indexParam = pThis->v[kParamIndex] * 0.001f;
-		float offset = indexParam * (pThis->request.numWaves - 1);
-		offset = std::max(0.0f, std::min(offset, (float)(pThis->request.numWaves - 1) - 0.0001f));
-		
-		int wave = (int)offset;
-		float frac = offset - wave;
+	// Draw waveform (or the kernel's response) if wavetable loaded and using mipmaps
+	const int numWaves = slot->numWaves;
+	if (pThis->wavetableLoaded && numWaves > 0) {
+		// Interpolate the waveform at the current wave position when it moves
+		if (tableChanged || pThis->v[kParamIndex] != display->index) {
+			float offset = waveOffset(numWaves, pThis->v[kParamIndex] * 0.001f);
+			int wave = (int)offset;
+			float frac = offset - wave;
+			
+			const int16_t* mip0 = waveMip(pThis, kDisplaySize, wave);
+			const int16_t* mip1 = waveMip(pThis, kDisplaySize, std::min(wave + 1, numWaves - 1));
+			for (int i = 0; i < kDisplaySize; ++i) {
+				float v0 = mip0[i];
+				float v1 = mip1[i];
+				float v = v0 + frac * (v1 - v0);
+				display->waveY[i] = 36.0f - v * (28.0f / 32768.0f);
+			}
+			display->index = pThis->v[kParamIndex];
+		}
 		
-		constexpr int kDisplaySize = 64;
-		const int16_t* mip0 = pThis->wavetableBuffer + kDisplaySize * (pThis->request.numWaves + wave);
-		const int16_t* mip1 = pThis->wavetableBuffer + kDisplaySize * (pThis->request.numWaves + std::min(wave + 1, (int)pThis->request.numWaves - 1));
+		// Morph blends two kernels per channel, so it shows the wave
+		const float* responseRows = NULL;
+		if (pThis->v[kParamDisplay] && !pThis->dtc->morph) {
+			const int front = pThis->responseFront.load(std::memory_order_acquire);
+			if (front >= 0) responseRows = pThis->response[front];
+		}
 		
 		float prevX = 0, prevY = 0;
 		for (int i = 0; i < kDisplaySize; ++i) {
-			float v0 = mip0[i];
-			float v1 = mip1[i];
-			float v = v0 + frac * (v1 - v0);
-			
 			float x = 192.0f + i;
-			float y = 36.0f - v * (28.0f / 32768.0f);
+			float y = responseRows ? 8.0f + 56.0f * responseRows[i] : display->waveY[i];
 			
 			if (i > 0) {
 				NT_drawShapeF(kNT_line, prevX, prevY, x, y, 12);
@@ -644,6 +4556,8 @@ static bool draw(_NT_algorithm* self) {
 		// Draw frame around waveform
 		NT_drawShapeI(kNT_box, 191, 7, 256, 65, 6);
 	}
+	display->slot = slot;
+	display->generation = generation;
 	
 	// Draw channel/depth info
 	char buf[32];
@@ -651,11 +4565,256 @@ static bool draw(_NT_algorithm* self) {
 	buf[len++] = 'c';
 	buf[len++] = 'h';
 	buf[len] = 0;
+	
+	// Kernels on the folded and half-rate paths, when they are in use
+	if (pThis->wavetableLoaded) {
+		const _rainbow_DTC* dtc = pThis->dtc;
+		const KernelBank* bank = &dtc->banks[dtc->frontBank];
+		const int numKernels = bank->shared ? 1 : pThis->numChannels;
+		int forms[kNumForms] = {};
+		if (!dtc->fixedPoint && !dtc->morph && !useFftEngine(dtc->kernelSize)) {
+			for (int ch = 0; ch < numKernels; ++ch) {
+				++forms[bank->form[ch]];
+			}
+		}
+		const int folded = forms[kFormEven] + forms[kFormOdd];
+		const int halfRate = forms[kFormHalfRate];
+		for (int i = 0; i < 2; ++i) {
+			const int count = i ? halfRate : folded;
+			if (!count)
+				continue;
+			strcpy(buf + len, i ? " half" : " fold");
+			len += 5;
+			if (!bank->shared) {
+				buf[len++] = ' ';
+				len += NT_intToString(buf + len, count);
+				buf[len] = 0;
+			}
+		}
+	}
 	NT_drawText(10, 50, buf, 10);
 	
+	// Effective kernel length after Energy truncation, or the chain's length
+	if (pThis->wavetableLoaded) {
+		const _rainbow_DTC* dtc = pThis->dtc;
+		const KernelBank* bank = &dtc->banks[dtc->frontBank];
+		if (bank->chainTaps) {
+			len = NT_intToString(buf, bank->chainTaps);
+			strcpy(buf + len, " tap chain");
+		} else {
+			len = NT_intToString(buf, bank->numTaps);
+			buf[len++] = '/';
+			len += NT_intToString(buf + len, dtc->kernelSize);
+			strcpy(buf + len, " taps");
+		}
+		NT_drawText(10, 60, buf, 10);
+	}
+	
+#ifdef RAINBOW_PROFILE
+	// min/avg/max cycles (per sample for audio phases, per call otherwise)
+	static const char* const profileNames[kNumProfileStats] = {
+		"step", "conv", "2nd", "mix", "swap", "build", "load",
+	};
+	for (int i = 0; i < kNumProfileStats; ++i) {
+		const ProfileStat* p = &pThis->profile[i];
+		const int y = 12 + i * 6;
+		NT_drawText(96, y, profileNames[i], 8, kNT_textLeft, kNT_textTiny);
+		if (p->count == 0)
+			continue;
+		len = NT_intToString(buf, (int32_t)p->min);
+		buf[len++] = '/';
+		len += NT_intToString(buf + len, (int32_t)p->avg);
+		buf[len++] = '/';
+		len += NT_intToString(buf + len, (int32_t)p->max);
+		NT_drawText(188, y, buf, 12, kNT_textRight, kNT_textTiny);
+	}
+	
+	// Where the hot stages run (make PLACEMENT=...)
+	static const char* const placementNames[] = { "flash", "itc", "sram" };
+#ifdef RAINBOW_COPY_HOT_CODE
+	const char* placement = placementNames[RAINBOW_PLACEMENT];
+#else
+	const char* placement = placementNames[RAINBOW_PLACE_FLASH];
+#endif
+	NT_drawText(96, 12 + kNumProfileStats * 6, placement, 8, kNT_textLeft, kNT_textTiny);
+#endif
+	
 	return false;  // Show standard parameter line
 }
 
+// ----------------------------------------------------------------------------
+// Preset state
+//
+// The playing kernels are saved with the preset, along with the name of
+// their wavetable: Q15 with a power-of-two scale per kernel, trimmed to
+// the effective length. A recalled preset convolves with them straight
+// away; the wavetable load that follows crossfades in over them.
+// ----------------------------------------------------------------------------
+
+static void serialise(_NT_algorithm* self, _NT_jsonStream& stream) {
+	_rainbowAlgorithm* pThis = (_rainbowAlgorithm*)self;
+	const _rainbow_DTC* dtc = pThis->dtc;
+	const KernelBank* bank = &dtc->banks[dtc->frontBank];
+	if (!pThis->wavetableLoaded || bank->numTaps == 0)
+		return;
+	if (bank->chainTaps)
+		return;  // too long to store; the preset's parameters rebuild it
+	
+	_NT_wavetableInfo info;
+	NT_getWavetableInfo(pThis->v[kParamWavetable], info);
+	stream.addMemberName("wavetable");
+	stream.addString(info.name ? info.name : "");
+	stream.addMemberName("kernelSize");
+	stream.addNumber(bank->kernelSize);
+	
+	// In morph mode this is each channel's even wave
+	const int numKernels = bank->shared ? 1 : pThis->numChannels;
+	stream.addMemberName("kernels");
+	stream.openArray();
+	for (int ch = 0; ch < numKernels; ++ch) {
+		const float* kernel = bank->kernels[ch];
+		const int taps = bank->taps[ch];
+		const int shift = q15Shift(kernel, taps);
+		
+		stream.openObject();
+		stream.addMemberName("shift");
+		stream.addNumber(shift);
+		stream.addMemberName("taps");
+		stream.openArray();
+		for (int i = 0; i < taps; ++i) {
+			stream.addNumber(toQ15(ldexpf(kernel[i], shift)));
+		}
+		stream.closeArray();
+		stream.closeObject();
+	}
+	stream.closeArray();
+}
+
+// One saved kernel into a staging slot; returns false on malformed JSON.
+// taps is -1 if the kernel is longer than the slot.
+// A NULL kernel parses the member and discards it
+static bool parseKernel(_NT_jsonParse& parse, int16_t* kernel, int maxKernelSize, int& taps, int& shift) {
+	int numMembers;
+	if (!parse.numberOfObjectMembers(numMembers))
+		return false;
+	
+	shift = 0;
+	taps = 0;
+	for (int m = 0; m < numMembers; ++m) {
+		if (parse.matchName("shift")) {
+			if (!parse.number(shift))
+				return false;
+		} else if (parse.matchName("taps")) {
+			int numTaps;
+			if (!parse.numberOfArrayElements(numTaps))
+				return false;
+			for (int i = 0; i < numTaps; ++i) {
+				int q;
+				if (!parse.number(q))
+					return false;
+				if (kernel && i < maxKernelSize)
+					kernel[i] = (int16_t)std::max(-32768, std::min(q, 32767));
+			}
+			taps = numTaps <= maxKernelSize ? numTaps : -1;
+		} else if (!parse.skipMember()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Claim the staging area for a preset, retracting one the kernel job has
+// not taken yet; false while the job is copying one out
+static bool claimPresetStaging(PresetKernels* preset) {
+	int expected = kPresetEmpty;
+	if (preset->state.compare_exchange_strong(expected, kPresetWriting, std::memory_order_acquire))
+		return true;
+	expected = kPresetReady;
+	return preset->state.compare_exchange_strong(expected, kPresetWriting, std::memory_order_acquire);
+}
+
+static bool deserialise(_NT_algorithm* self, _NT_jsonParse& parse) {
+	_rainbowAlgorithm* pThis = (_rainbowAlgorithm*)self;
+	const int maxKernelSize = kKernelSizes[pThis->maxSizeIndex];
+	
+	int numMembers;
+	if (!parse.numberOfObjectMembers(numMembers))
+		return false;
+	
+	// Kernels are parsed into the staging area, and handed to step()'s
+	// kernel job only if they still fit this instance and the wavetable
+	// they came from. While the job is copying out an earlier preset they
+	// are skipped, and the table builds the kernels when it loads.
+	PresetKernels* preset = &pThis->preset;
+	bool staging = false;
+	bool usable = !pThis->wavetableLoaded;  // a loaded table takes precedence
+	int kernelSize = 0;
+	int numKernels = 0;
+	int numTaps = 0;
+	for (int m = 0; m < numMembers; ++m) {
+		if (parse.matchName("wavetable")) {
+			const char* name;
+			if (!parse.string(name))
+				return false;
+			// Without the card the name can't be checked; trust the preset
+			_NT_wavetableInfo info;
+			NT_getWavetableInfo(pThis->v[kParamWavetable], info);
+			if (info.name && strcmp(info.name, name) != 0)
+				usable = false;
+		} else if (parse.matchName("kernelSize")) {
+			if (!parse.number(kernelSize))
+				return false;
+		} else if (parse.matchName("kernels")) {
+			if (!parse.numberOfArrayElements(numKernels))
+				return false;
+			if (!staging)
+				staging = claimPresetStaging(preset);
+			numTaps = 0;
+			for (int k = 0; k < numKernels; ++k) {
+				// Surplus kernels are parsed into the last slot and discarded
+				const int ch = std::min(k, pThis->numChannels - 1);
+				int taps, shift;
+				if (!parseKernel(parse, staging ? preset->taps + ch * maxKernelSize : NULL, maxKernelSize, taps, shift)) {
+					if (staging) preset->state.store(kPresetEmpty, std::memory_order_release);
+					return false;
+				}
+				if (!staging)
+					continue;
+				preset->numTaps[ch] = taps;
+				preset->shift[ch] = shift;
+				numTaps = std::max(numTaps, taps);
+				if (taps < 0)
+					usable = false;
+			}
+		} else if (!parse.skipMember()) {
+			if (staging)
+				preset->state.store(kPresetEmpty, std::memory_order_release);
+			return false;
+		}
+	}
+	if (!staging)
+		return true;  // saved without a table loaded, or the job is busy with another preset
+	
+	bool validSize = false;
+	for (int i = 0; i <= pThis->maxSizeIndex; ++i) {
+		validSize |= kKernelSizes[i] == kernelSize;
+	}
+	if (!usable || !validSize || numTaps > kernelSize
+	    || (numKernels != 1 && numKernels != pThis->numChannels)) {
+		preset->state.store(kPresetEmpty, std::memory_order_release);
+		return true;
+	}
+	
+	preset->kernelSize = kernelSize;
+	preset->shared = numKernels == 1;
+	preset->state.store(kPresetReady, std::memory_order_release);
+	requestKernels(pThis, kJobPreset);
+	
+	// Convolve until the table arrives, which then crossfades in
+	pThis->wavetableLoaded = true;
+	return true;
+}
+
 // ============================================================================
 // FACTORY DEFINITION
 // ============================================================================
@@ -666,8 +4825,8 @@ static const _NT_factory factory = {
 	.description = "Wavetable FIR convolution effect",
 	.numSpecifications = ARRAY_SIZE(specifications),
 	.specifications = specifications,
-	.calculateStaticRequirements = NULL,
-	.initialise = NULL,
+	.calculateStaticRequirements = calculateStaticRequirements,
+	.initialise = initialise,
 	.calculateRequirements = calculateRequirements,
 	.construct = construct,
 	.parameterChanged = parameterChanged,
@@ -679,8 +4838,8 @@ static const _NT_factory factory = {
 	.hasCustomUi = NULL,
 	.customUi = NULL,
 	.setupUi = NULL,
-	.serialise = NULL,
-	.deserialise = NULL,
+	.serialise = serialise,
+	.deserialise = deserialise,
 	.midiSysEx = NULL,
 	.parameterUiPrefix = parameterUiPrefix,
 	.parameterString = parameterString,